@@ -0,0 +1,64 @@
+ /******************************************************************************
+ *
+ * Module: CRC
+ *
+ * File Name: crc.c
+ *
+ * Description: Source file for the CRC-8 checksum used by the link protocol
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#include "crc.h"
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Update a running CRC-8 value with one more data byte.
+ */
+uint8 CRC8_update(uint8 crc, uint8 data)
+{
+	uint8 bit;
+
+	crc ^= data;
+	for(bit = 0; bit < 8; bit++)
+	{
+		if(crc & 0x80)
+		{
+			crc = (uint8)((crc << 1) ^ CRC8_POLYNOMIAL);
+		}
+		else
+		{
+			crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+/*
+ * Description :
+ * Calculate the CRC-8 of len bytes starting at data.
+ */
+uint8 CRC8_compute(const uint8 *data, uint8 len)
+{
+	return CRC8_computeFrom(CRC8_INITIAL_VALUE, data, len);
+}
+
+/*
+ * Description :
+ * Calculate the CRC-8 of len bytes starting at data, starting from the given initial value.
+ */
+uint8 CRC8_computeFrom(uint8 crc, const uint8 *data, uint8 len)
+{
+	uint8 i;
+
+	for(i = 0; i < len; i++)
+	{
+		crc = CRC8_update(crc, data[i]);
+	}
+	return crc;
+}
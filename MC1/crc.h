@@ -0,0 +1,52 @@
+ /******************************************************************************
+ *
+ * Module: CRC
+ *
+ * File Name: crc.h
+ *
+ * Description: Header file for the CRC-8 checksum used by the link protocol
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#ifndef CRC_H_
+#define CRC_H_
+
+#include "std_types.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+/* CRC-8 polynomial x^8 + x^2 + x + 1 (CRC-8/SMBUS), initial value 0x00 */
+#define CRC8_POLYNOMIAL         0x07
+#define CRC8_INITIAL_VALUE      0x00
+/*
+ * Initial value for data kept in the EEPROM: with 0x00 an all-zero block has a CRC of 0x00 and
+ * passes as valid, with 0xFF neither an erased (all 0xFF) nor a zeroed block checks out.
+ */
+#define CRC8_STORAGE_INITIAL_VALUE 0xFF
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Update a running CRC-8 value with one more data byte.
+ */
+uint8 CRC8_update(uint8 crc, uint8 data);
+
+/*
+ * Description :
+ * Calculate the CRC-8 of len bytes starting at data.
+ */
+uint8 CRC8_compute(const uint8 *data, uint8 len);
+
+/*
+ * Description :
+ * Calculate the CRC-8 of len bytes starting at data, starting from the given initial value.
+ */
+uint8 CRC8_computeFrom(uint8 crc, const uint8 *data, uint8 len);
+
+#endif /* CRC_H_ */
@@ -12,6 +12,15 @@
 #include "common_macros.h" /* To use the macros like SET_BIT */
 #include "keypad.h"
 #include "gpio.h"
+#include "sw_timer.h"
+#include "power.h"
+#include "profile.h"
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* Timer pacing the keypad scans so the CPU can sleep between them */
+static SwTimer g_scanTimer;
 
 /*******************************************************************************
  *                      Functions Prototypes(Private)                          *
@@ -36,42 +45,69 @@ static uint8 KEYPAD_4x4_adjustKeyNumber(uint8 button_number);
  *******************************************************************************/
 uint8 KEYPAD_getPressedKey(void)
 {
-	uint8 col,row;
-	uint8 keypad_port_value = 0;
+	uint8 key;
 	while(1)
 	{
-		for(col=0;col<KEYPAD_NUM_COLS;col++) /* loop for columns */
+		key = KEYPAD_scan();
+		if(key != KEYPAD_NO_KEY)
 		{
-			/* 
-			 * Each time setup the direction for all keypad port as input pins,
-			 * except this column will be output pin
-			 */
-			GPIO_setupPortDirection(KEYPAD_PORT_ID,PORT_INPUT);
-			GPIO_setupPinDirection(KEYPAD_PORT_ID,KEYPAD_FIRST_COLUMN_PIN_ID+col,PIN_OUTPUT);
-			
+			return key;
+		}
+
+		/* No button pressed: sleep until the next scan */
+		SwTimer_start(&g_scanTimer, KEYPAD_SCAN_PERIOD_MS, SW_TIMER_ONE_SHOT, NULL_PTR);
+		while(SwTimer_isActive(&g_scanTimer))
+		{
+			Power_idle();
+		}
+	}	
+}
+
+uint8 KEYPAD_scan(void)
+{
+	uint8 col,row;
+	uint8 keypad_port_value = 0;
+	uint8 key = KEYPAD_NO_KEY;
+	PROFILE_BEGIN(PROFILE_KEYPAD_SCAN);
+	for(col=0;(col<KEYPAD_NUM_COLS) && (key == KEYPAD_NO_KEY);col++) /* loop for columns */
+	{
+		/* 
+		 * Each time setup the direction for all keypad port as input pins,
+		 * except this column will be output pin
+		 */
+		GPIO_setupPortDirection(KEYPAD_PORT_ID,PORT_INPUT);
+		GPIO_setupPinDirection(KEYPAD_PORT_ID,KEYPAD_FIRST_COLUMN_PIN_ID+col,PIN_OUTPUT);
+		
 #if(KEYPAD_BUTTON_PRESSED == LOGIC_LOW)
-			/* Clear the column output pin and set the rest pins value */
-			keypad_port_value = ~(1<<(KEYPAD_FIRST_COLUMN_PIN_ID+col));
+		/* Clear the column output pin and set the rest pins value */
+		keypad_port_value = ~(1<<(KEYPAD_FIRST_COLUMN_PIN_ID+col));
 #else
-			/* Set the column output pin and clear the rest pins value */
-			keypad_port_value = (1<<(KEYPAD_FIRST_COLUMN_PIN_ID+col));
+		/* Set the column output pin and clear the rest pins value */
+		keypad_port_value = (1<<(KEYPAD_FIRST_COLUMN_PIN_ID+col));
 #endif
-			GPIO_writePort(KEYPAD_PORT_ID,keypad_port_value);
+		GPIO_writePort(KEYPAD_PORT_ID,keypad_port_value);
 
-			for(row=0;row<KEYPAD_NUM_ROWS;row++) /* loop for rows */
+		for(row=0;(row<KEYPAD_NUM_ROWS) && (key == KEYPAD_NO_KEY);row++) /* loop for rows */
+		{
+			/* Check if the switch is pressed in this row */
+			if(GPIO_readPin(KEYPAD_PORT_ID,row+KEYPAD_FIRST_ROW_PIN_ID) == KEYPAD_BUTTON_PRESSED)
 			{
-				/* Check if the switch is pressed in this row */
-				if(GPIO_readPin(KEYPAD_PORT_ID,row+KEYPAD_FIRST_ROW_PIN_ID) == KEYPAD_BUTTON_PRESSED)
-				{
-					#if (KEYPAD_NUM_COLS == 3)
-						return KEYPAD_4x3_adjustKeyNumber((row*KEYPAD_NUM_COLS)+col+1);
-					#elif (KEYPAD_NUM_COLS == 4)
-						return KEYPAD_4x4_adjustKeyNumber((row*KEYPAD_NUM_COLS)+col+1);
-					#endif
-				}
+				#if (KEYPAD_NUM_COLS == 3)
+					key = KEYPAD_4x3_adjustKeyNumber((row*KEYPAD_NUM_COLS)+col+1);
+				#elif (KEYPAD_NUM_COLS == 4)
+					key = KEYPAD_4x4_adjustKeyNumber((row*KEYPAD_NUM_COLS)+col+1);
+				#endif
 			}
 		}
-	}	
+	}
+#if (PROFILE_ENABLED == 1)
+	/* Only the scans finding no key are timed, they are nearly all of them and run the full loop */
+	if(key == KEYPAD_NO_KEY)
+	{
+		PROFILE_END(PROFILE_KEYPAD_SCAN);
+	}
+#endif
+	return key;
 }
 
 #if (KEYPAD_NUM_COLS == 3)
@@ -29,6 +29,12 @@
 #define KEYPAD_FIRST_ROW_PIN_ID           PIN0_ID
 #define KEYPAD_FIRST_COLUMN_PIN_ID        PIN4_ID
 
+/* Period between two scans of the keypad while no button is pressed, the CPU sleeps in between */
+#define KEYPAD_SCAN_PERIOD_MS            10
+
+/* Returned by KEYPAD_scan when no button is pressed */
+#define KEYPAD_NO_KEY                    0xFF
+
 /* Keypad button logic configurations */
 #define KEYPAD_BUTTON_PRESSED            LOGIC_LOW
 #define KEYPAD_BUTTON_RELEASED           LOGIC_HIGH
@@ -43,4 +49,10 @@
  */
 uint8 KEYPAD_getPressedKey(void);
 
+/*
+ * Description :
+ * Scan the keypad once without waiting, return the pressed button or KEYPAD_NO_KEY
+ */
+uint8 KEYPAD_scan(void);
+
 #endif /* KEYPAD_H_ */
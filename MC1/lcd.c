@@ -14,6 +14,7 @@
 #include "common_macros.h" /* To use the macros like SET_BIT */
 #include "lcd.h"
 #include "gpio.h"
+#include "profile.h"
 
 /*******************************************************************************
  *                      Functions Definitions                                  *
@@ -60,6 +61,7 @@ void LCD_init(void)
 void LCD_sendCommand(uint8 command)
 {
 	uint8 lcd_port_value = 0;
+	PROFILE_BEGIN(PROFILE_LCD_SEND_COMMAND);
 	GPIO_writePin(LCD_RS_PORT_ID,LCD_RS_PIN_ID,LOGIC_LOW); /* Instruction Mode RS=0 */
 	GPIO_writePin(LCD_RW_PORT_ID,LCD_RW_PIN_ID,LOGIC_LOW); /* write data to LCD so RW=0 */
 	_delay_ms(1); /* delay for processing Tas = 50ns */
@@ -101,6 +103,7 @@ void LCD_sendCommand(uint8 command)
 	GPIO_writePin(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_LOW); /* Disable LCD E=0 */
 	_delay_ms(1); /* delay for processing Th = 13ns */
 #endif
+	PROFILE_END(PROFILE_LCD_SEND_COMMAND);
 }
 
 /*
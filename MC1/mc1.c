@@ -11,9 +11,15 @@
 #include "mc1.h"
 #include "lcd.h"
 #include "keypad.h"
-#include "timer.h"
-#include "avr/delay.h"
+#include "sw_timer.h"
+#include "power.h"
+#include "spsc_queue.h"
+#include <string.h>
 #include "uart.h"
+#include "protocol.h"
+#include "profile.h"
+#include "pt.h"
+#include "supervisor.h"
 #include "avr/io.h" /* To use the UART Registers */
 #include "common_macros.h" /* To use the macros like SET_BIT */
 
@@ -21,201 +27,488 @@
  *                      Global Variables                                       *
  *******************************************************************************/
 
+AppState g_state;
+Protothread g_setPasswordPt;
+Protothread g_requestPt;
+Protothread g_negotiatePt;
+uint8 g_passwords[2 * PASS_SIZE]; /* password being set and its confirmation */
 uint8 g_inputPassword[PASS_SIZE];
-uint8 g_password_match_status = 0;
-uint16 g_seconds = 0;
+uint8 g_inputCount = 0;
+uint8 g_option; /* option chosen in the main menu */
 uint8 g_wrongPasswordCounter=0;
+/* timed states and messages */
+uint8 g_secondsLeft;
+AppState g_nextState;
+/* pending request to Control ECU */
+uint8 g_requestType;
+uint8 g_requestPayload[2 * PASS_SIZE];
+uint8 g_requestLength;
+uint8 g_retriesLeft;
+uint8 g_reply; /* response code of the last request, NO_REPLY if Control ECU did not answer */
+boolean g_negotiateBaud = TRUE;
+uint8 g_baudCandidate; /* baud table index being negotiated */
+boolean g_linkUp = TRUE; /* Control ECU answered the last request */
+/* keypad debouncing */
+uint8 g_lastReading = KEYPAD_NO_KEY;
+uint8 g_stableKey = KEYPAD_NO_KEY;
+
+/* timer events, posted from the Timer1 interrupt only */
+uint8 g_eventBuffer[EVENT_QUEUE_SIZE * sizeof(Event)];
+_Static_assert(SPSC_QUEUE_SIZE_IS_VALID(sizeof(g_eventBuffer)), "event queue size must be a power of two up to 128 bytes");
+SpscQueue g_eventQueue = SPSC_QUEUE_INITIALIZER(g_eventBuffer);
+
+SwTimer g_secondTimer;
+SwTimer g_keypadTimer;
+SwTimer g_stateTimer;
+SwTimer g_replyTimer;
 
 /*******************************************************************************
  *                      Functions Definitions                                  *
  *******************************************************************************/
 
-void getPassword(uint8 * arrayName)
+void postEvent(EventType type, uint8 data)
 {
-	uint8 i=0,key=0;
-	LCD_moveCursor(1, 0);
+	Event event;
 
-	while(i != PASS_SIZE)
-	{
-		key = KEYPAD_getPressedKey();
-		if (key >= 0 && key <= 9) {
-			LCD_displayCharacter('*');
-			*(arrayName + i) = key;
-			i++;
+	event.type = type;
+	event.data = data;
+	SpscQueue_write(&g_eventQueue, (const uint8 *)&event, sizeof(Event));
+}
+
+boolean getEvent(Event * event)
+{
+	return SpscQueue_read(&g_eventQueue, (uint8 *)event, sizeof(Event));
+}
+
+void dispatchEvent(const Event * event)
+{
+	Event keyEvent;
+
+	if (event->type == EVENT_KEYPAD_SCAN) {
+		keyEvent.type = EVENT_KEY;
+		keyEvent.data = scanKeypad();
+		if (keyEvent.data != KEYPAD_NO_KEY) {
+			dispatchEvent(&keyEvent);
 		}
-		_delay_ms(KEYPAD_INPUT_DELAY);
+		/* the scan goes on to the state too, a protothread waiting on a condition is polled by it */
 	}
-	key=0;
 
-	/* stay till user pushes Enter */
-	while(KEYPAD_getPressedKey() != 13);
+	switch (g_state) {
+	case STATE_SET_PASSWORD:
+		if (!PT_SCHEDULE(setPasswordThread(&g_setPasswordPt, event))) {
+			enterState(STATE_MAIN_MENU);
+		}
+		break;
+
+	case STATE_MAIN_MENU:
+		if (event->type == EVENT_KEY) {
+			if (event->data == '+' || event->data == '-') {
+				g_option = (event->data == '+') ? '+' : CHANGE_PASSWORD_OPTION;
+				enterState(STATE_ENTER_PASSWORD);
+			}
+#if (PROFILE_ENABLED == 1)
+			else if (event->data == '*') {
+				/* dump the probes of both ECUs, Control ECU answers with its own MSG_PROFILE_DATA frames */
+				Profile_dump(MSG_PROFILE_DATA);
+				PROTOCOL_sendFrame(MSG_PROFILE_DUMP, NULL_PTR, 0);
+			}
+#endif
+		}
+		break;
+
+	case STATE_ENTER_PASSWORD:
+		if (event->type == EVENT_KEY && passwordKey(event->data)) {
+			/* inform Control ECU the option that user chose along with the password */
+			g_requestPayload[0] = g_option;
+			memcpy(g_requestPayload + 1, g_inputPassword, PASS_SIZE);
+			startRequest(MSG_COMMAND, g_requestPayload, PASS_SIZE + 1);
+			g_state = STATE_WAIT_REPLY;
+			requestThread(&g_requestPt, event);
+		}
+		break;
+
+	case STATE_WAIT_REPLY:
+		if (!PT_SCHEDULE(requestThread(&g_requestPt, event))) {
+			handleReply(g_reply);
+		}
+		break;
+
+	case STATE_MESSAGE:
+	case STATE_DOOR_UNLOCKING:
+	case STATE_DOOR_OPEN:
+	case STATE_DOOR_LOCKING:
+		if (countdownElapsed(event)) {
+			enterState(g_nextState);
+		} else if (event->type == EVENT_STATE_SECOND && g_state != STATE_MESSAGE) {
+			LCD_moveCursor(1, 0);
+			LCD_intgerToString(g_secondsLeft);
+			LCD_displayString(" s ");
+		}
+		break;
+
+	case STATE_LOCKED_OUT:
+	default:
+		/* the panel stays locked, events are ignored */
+		break;
+	}
 }
 
-void appMainOptions(void)
+void enterState(AppState state)
 {
-	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 0, "+: Open Door");
-	LCD_displayStringRowColumn(1, 0, "-: Change Pass");
+	g_state = state;
+	switch (state) {
+	case STATE_SET_PASSWORD:
+		/* run the flow up to its first wait */
+		PT_INIT(&g_setPasswordPt);
+		setPasswordThread(&g_setPasswordPt, NULL_PTR);
+		break;
+	case STATE_MAIN_MENU:
+		appMainOptions();
+		break;
+	case STATE_ENTER_PASSWORD:
+		showPrompt((g_option == '+') ? "Enter Pass" : "Enter Your Pass");
+		break;
+	case STATE_DOOR_UNLOCKING:
+		LCD_clearScreen();
+		LCD_displayStringRowColumn(0, 0, "Opening Door...");
+		startCountdown(DOOR_UNLOCKING_PERIOD);
+		g_nextState = STATE_DOOR_OPEN;
+		break;
+	case STATE_DOOR_OPEN:
+		/* the door is left open for 3 seconds */
+		LCD_clearScreen();
+		LCD_displayStringRowColumn(0, 0, "Door is now open");
+		startCountdown(DOOR_LEFT_OPEN_PERIOD);
+		g_nextState = STATE_DOOR_LOCKING;
+		break;
+	case STATE_DOOR_LOCKING:
+		LCD_clearScreen();
+		LCD_displayStringRowColumn(0, 0, "Locking Door...");
+		startCountdown(DOOR_UNLOCKING_PERIOD);
+		g_nextState = STATE_MAIN_MENU;
+		break;
+	case STATE_MESSAGE:
+		/* the message text is on the LCD already, g_nextState is set by showMessage */
+		startCountdown(DISPLAY_MESSAGE_DELAY / 1000);
+		break;
+	case STATE_LOCKED_OUT:
+		LCD_clearScreen();
+		LCD_displayStringRowColumn(0, 5, "WARNING!!");
+		LCD_displayStringRowColumn(1, 0, "Calling Security");
+		break;
+	case STATE_WAIT_REPLY:
+	default:
+		break;
+	}
 }
 
-void initializePassword(void)
+PT_THREAD(setPasswordThread(Protothread * pt, const Event * event))
 {
-	while(g_password_match_status == PASSWORD_MISMATCHED)
-	{
-		LCD_clearScreen();
-		LCD_displayStringRowColumn(0, 0, "New Pass:");
-		LCD_moveCursor(1, 0);
-		getPassword(g_inputPassword); /* get the password from user */
-		UART_sendByte(READY_TO_SEND);
-		while (UART_recieveByte() != READY_TO_RECEIVE); /* wait for a response */
-		sendPasswordViaUART(g_inputPassword);
+	PT_BEGIN(pt);
+	do {
+		showPrompt("New Pass:");
+		PT_YIELD_UNTIL(pt, event->type == EVENT_KEY && passwordKey(event->data));
+		memcpy(g_passwords, g_inputPassword, PASS_SIZE);
 
 		/* get confirm password from user */
-		LCD_clearScreen();
-		LCD_displayStringRowColumn(0, 0, "Re-enter Pass");
-		LCD_moveCursor(1, 0);
-		getPassword(g_inputPassword);
-		UART_sendByte(READY_TO_SEND);
-		while (UART_recieveByte() != READY_TO_RECEIVE);
-		sendPasswordViaUART(g_inputPassword);
-
-		/* wait for a response from Control ECU about passwords matching */
-		while (UART_recieveByte() != READY_TO_SEND);
-		g_password_match_status = UART_recieveByte();
-
-		if (g_password_match_status == PASSWORD_MISMATCHED){
+		showPrompt("Re-enter Pass");
+		PT_YIELD_UNTIL(pt, event->type == EVENT_KEY && passwordKey(event->data));
+		memcpy(g_passwords + PASS_SIZE, g_inputPassword, PASS_SIZE);
+
+		/* send both passwords in one frame & wait for Control ECU reply about passwords matching */
+		startRequest(MSG_SET_PASSWORD, g_passwords, 2 * PASS_SIZE);
+		PT_WAIT_THREAD(pt, requestThread(&g_requestPt, event));
+
+		if (g_reply != PASSWORD_MATCHED) {
 			LCD_clearScreen();
-			LCD_displayString("Incorrect Pass");
-			_delay_ms(DISPLAY_MESSAGE_DELAY);
+			if (g_reply == NO_REPLY) {
+				LCD_displayString("No Response");
+			} else if (g_reply == PASSWORD_SET) {
+				LCD_displayString("Pass Unchanged"); /* Control ECU was reset and kept the old one */
+			} else if (g_reply == PASSWORD_NOT_SAVED) {
+				LCD_displayString("Pass Not Saved"); /* the old one (if any) stays, try again */
+			} else {
+				LCD_displayString("Incorrect Pass");
+			}
+			startCountdown(DISPLAY_MESSAGE_DELAY / 1000);
+			PT_YIELD_UNTIL(pt, countdownElapsed(event));
 		}
+	} while (g_reply != PASSWORD_MATCHED && g_reply != PASSWORD_SET);
+	PT_END(pt);
+}
+
+void startRequest(uint8 type, const uint8 * payload, uint8 length)
+{
+	g_requestType = type;
+	if (payload != g_requestPayload) {
+		memcpy(g_requestPayload, payload, length);
 	}
-	g_password_match_status = PASSWORD_MISMATCHED;
+	g_requestLength = length;
+	PT_INIT(&g_requestPt);
 }
 
-void sendPasswordViaUART(uint8 * passwordArray)
+PT_THREAD(requestThread(Protothread * pt, const Event * event))
 {
-	uint8 cnt;
-	for (cnt=0;cnt<PASS_SIZE;cnt++){
-		UART_sendByte(passwordArray[cnt]);
-		_delay_ms(100);
+	PT_BEGIN(pt);
+
+	/* move to the fastest baud rate at first use and again once the link is back after a fallback */
+	if (g_negotiateBaud && g_linkUp) {
+		PT_SPAWN(pt, &g_negotiatePt, negotiateThread(&g_negotiatePt, event));
+		g_negotiateBaud = FALSE;
 	}
+
+	g_retriesLeft = REPLY_RETRIES;
+	PROTOCOL_sendFrame(g_requestType, g_requestPayload, g_requestLength);
+	SwTimer_start(&g_replyTimer, PROTOCOL_REPLY_TIMEOUT_MS, SW_TIMER_ONE_SHOT, replyTimerCallBack);
+
+	while (1) {
+		PT_YIELD_UNTIL(pt, event->type == EVENT_REPLY || event->type == EVENT_REPLY_TIMEOUT);
+		if (event->type == EVENT_REPLY) {
+			SwTimer_cancel(&g_replyTimer);
+			g_linkUp = TRUE;
+			g_reply = event->data;
+			PT_EXIT(pt);
+		}
+
+		g_linkUp = FALSE;
+		if (g_retriesLeft == 0) {
+			/* give up on this request, the panel stays usable */
+			g_reply = NO_REPLY;
+			PT_EXIT(pt);
+		}
+
+		/* no reply: bring both ECUs back to the safe baud rate and try again */
+		g_retriesLeft--;
+		PT_WAIT_UNTIL(pt, UART_isTxComplete());
+		PROTOCOL_linkFallback();
+		g_negotiateBaud = TRUE;
+		PROTOCOL_sendFrame(g_requestType, g_requestPayload, g_requestLength);
+		SwTimer_start(&g_replyTimer, PROTOCOL_REPLY_TIMEOUT_MS, SW_TIMER_ONE_SHOT, replyTimerCallBack);
+	}
+	PT_END(pt);
 }
 
-void timerCallBack(void){
-	g_seconds++;
+PT_THREAD(negotiateThread(Protothread * pt, const Event * event))
+{
+	PT_BEGIN(pt);
+
+	for (g_baudCandidate = UART_getBaudCount() - 1; g_baudCandidate > UART_getBaudIndex(); g_baudCandidate--) {
+		if (!UART_isBaudUsable(g_baudCandidate)) {
+			continue;
+		}
+
+		PROTOCOL_sendFrame(PROTOCOL_MSG_BAUD_REQUEST, &g_baudCandidate, 1);
+		SwTimer_start(&g_replyTimer, PROTOCOL_REPLY_TIMEOUT_MS, SW_TIMER_ONE_SHOT, replyTimerCallBack);
+		PT_YIELD_UNTIL(pt, event->type == EVENT_BAUD_ACCEPT || event->type == EVENT_BAUD_REJECT
+				|| event->type == EVENT_REPLY_TIMEOUT);
+
+		if (event->type == EVENT_BAUD_ACCEPT && event->data == g_baudCandidate) {
+			/* Control ECU has switched already, follow it and check the link at the new rate */
+			UART_setBaudIndex(g_baudCandidate);
+			PROTOCOL_sendFrame(PROTOCOL_MSG_LINK_CHECK, NULL_PTR, 0);
+			SwTimer_start(&g_replyTimer, PROTOCOL_REPLY_TIMEOUT_MS, SW_TIMER_ONE_SHOT, replyTimerCallBack);
+			PT_YIELD_UNTIL(pt, event->type == EVENT_LINK_CHECK_ACK || event->type == EVENT_REPLY_TIMEOUT);
+			if (event->type == EVENT_LINK_CHECK_ACK) {
+				SwTimer_cancel(&g_replyTimer);
+				PT_EXIT(pt);
+			}
+		}
+
+		/*
+		 * No answer, a reject, a lost accept or a failed link check: Control ECU may have
+		 * switched already so force both sides back to the safe rate.
+		 */
+		SwTimer_cancel(&g_replyTimer);
+		PT_WAIT_UNTIL(pt, UART_isTxComplete());
+		PROTOCOL_linkFallback();
+	}
+	PT_END(pt);
 }
 
-void DoorOpeningTask(void)
+void appMainOptions(void)
 {
-	g_seconds=0;
 	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 0, "Opening Door...");
-	while (g_seconds < DOOR_UNLOCKING_PERIOD);
+	LCD_displayStringRowColumn(0, 0, "+: Open Door");
+	LCD_displayStringRowColumn(1, 0, "-: Change Pass");
+}
 
-	/* let the door be open for 3 seconds */
-	g_seconds = 0;
+void showPrompt(const char * prompt)
+{
+	g_inputCount = 0;
 	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 0, "Door is now open");
-	while (g_seconds < DOOR_LEFT_OPEN_PERIOD);
+	LCD_displayStringRowColumn(0, 0, prompt);
+	LCD_moveCursor(1, 0);
+}
+
+boolean passwordKey(uint8 key)
+{
+	if (key <= 9 && g_inputCount < PASS_SIZE) {
+		LCD_displayCharacter('*');
+		g_inputPassword[g_inputCount] = key;
+		g_inputCount++;
+	} else if (key == ENTER_KEY && g_inputCount == PASS_SIZE) {
+		return TRUE;
+	}
+	return FALSE;
+}
+
+void handleReply(uint8 reply)
+{
+	if (reply == UNLOCKING_DOOR) {
+		enterState(STATE_DOOR_UNLOCKING); /* display door status while Control ECU moves it */
+	} else if (reply == CHANGING_PASSWORD || reply == PASSWORD_NOT_SET) {
+		enterState(STATE_SET_PASSWORD);
+	} else if (reply == WRONG_PASSWORD) {
+		wrongPassword();
+	} else if (reply == NO_REPLY) {
+		showMessage("No Response", STATE_MAIN_MENU);
+	} else {
+		enterState(STATE_MAIN_MENU);
+	}
+}
+
+void wrongPassword(void)
+{
+	g_wrongPasswordCounter++;
+	if (g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS) {
+		enterState(STATE_LOCKED_OUT);
+	} else {
+		showMessage("Incorrect Pass", STATE_MAIN_MENU);
+	}
+}
 
-	/* hold the system for 15 seconds & display to user that door is locking */
-	g_seconds = 0;
+void showMessage(const char * message, AppState next)
+{
 	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 0, "Locking Door...");
-	while (g_seconds < DOOR_UNLOCKING_PERIOD);
+	LCD_displayString(message);
+	g_nextState = next;
+	enterState(STATE_MESSAGE);
+}
+
+void startCountdown(uint8 seconds)
+{
+	g_secondsLeft = seconds;
+	SwTimer_start(&g_stateTimer, 1000, SW_TIMER_PERIODIC, stateTimerCallBack);
+}
+
+boolean countdownElapsed(const Event * event)
+{
+	if (event->type == EVENT_STATE_SECOND && g_secondsLeft != 0) {
+		g_secondsLeft--;
+		if (g_secondsLeft == 0) {
+			SwTimer_cancel(&g_stateTimer);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+uint8 scanKeypad(void)
+{
+	uint8 reading = KEYPAD_scan();
+	uint8 key = KEYPAD_NO_KEY;
+
+	if (reading == g_lastReading && reading != g_stableKey) {
+		g_stableKey = reading;
+		key = reading;
+	}
+	g_lastReading = reading;
+	return key;
+}
+
+void handleFrame(const PROTOCOL_Frame * frame)
+{
+	Event event;
+
+	/* answers carrying a value must carry exactly one byte, anything else is dropped */
+	switch (frame->type) {
+	case MSG_REPLY:
+		event.type = EVENT_REPLY;
+		break;
+	case PROTOCOL_MSG_BAUD_ACCEPT:
+		event.type = EVENT_BAUD_ACCEPT;
+		break;
+	case PROTOCOL_MSG_BAUD_REJECT:
+		event.type = EVENT_BAUD_REJECT;
+		break;
+	case PROTOCOL_MSG_LINK_CHECK_ACK:
+		event.type = EVENT_LINK_CHECK_ACK;
+		event.data = 0;
+		dispatchEvent(&event);
+		return;
+#if (PROFILE_ENABLED == 1)
+	case MSG_PROFILE_DATA:
+		/*
+		 * the records of Control ECU are sent on after our own table and the MSG_PROFILE_DUMP
+		 * that asked for them, so a monitor on the TX line gets both tables (Control ECU drops them)
+		 */
+		PROTOCOL_sendFrame(MSG_PROFILE_DATA, frame->payload, frame->length);
+		return;
+#endif
+	default:
+		return;
+	}
+	if (frame->length == 1) {
+		event.data = frame->payload[0];
+		dispatchEvent(&event);
+	}
+}
+
+void timerCallBack(void){
+	UART_updateThroughput();
+}
+
+void keypadScanCallBack(void){
+	postEvent(EVENT_KEYPAD_SCAN, 0);
+}
+
+void stateTimerCallBack(void){
+	postEvent(EVENT_STATE_SECOND, 0);
+}
+
+void replyTimerCallBack(void){
+	postEvent(EVENT_REPLY_TIMEOUT, 0);
 }
 
 
 int main(void)
 {
+	Event event;
+	PROTOCOL_Frame frame;
+
 	/* Enable I-Bit */
 	SREG |=(1<<SREG_I);
 	UART_configType UART_Config = {DISABLED, ONE_BIT, BIT_8};
 	UART_init(UART_BAUD_RATE,&UART_Config);
 
-	/* Timer freq = 8MHz/1024, one clock-cycle time = 128 uSecond
-		so to force the timer to produce an interrupt every 1 second:
-		we set the compare value to be 1/(128u) = 7813 */
-	Timer_Config TIMER_Config = {Timer1, CTC,0, 7813, Prescale_1024, timerCallBack};
-	Timer_init(&TIMER_Config);
+	/* Timer1 drives the software timers, one of them calls timerCallBack every 1 second */
+	SwTimer_init();
+	SwTimer_start(&g_secondTimer, 1000, SW_TIMER_PERIODIC, timerCallBack);
+	SwTimer_start(&g_keypadTimer, KEYPAD_SCAN_PERIOD_MS, SW_TIMER_PERIODIC, keypadScanCallBack);
+
+	/* the event loop has to come round at least every MAIN_LOOP_DEADLINE_MS or the MCU is reset */
+	Supervisor_init(NULL_PTR);
+	uint8 mainLoopTask = Supervisor_addTask(MAIN_LOOP_DEADLINE_MS);
 
 	/* Initialize LCD */
 	LCD_init();
 
-	uint8 receivedByte=0,key=0;
-
-	initializePassword(); /* initialize first-time password */
-	appMainOptions(); /* Display application options */
+	/* a password is set first-time only, Control ECU keeps it through resets of either ECU */
+	startRequest(MSG_PASSWORD_STATUS, g_requestPayload, 0);
+	enterState(STATE_WAIT_REPLY);
+	requestThread(&g_requestPt, NULL_PTR);
 
 	while(1)
 	{
-		key=KEYPAD_getPressedKey();
-		if (key == '+') {
-			LCD_clearScreen();
-			LCD_displayString("Enter Pass");
-			getPassword(g_inputPassword);
-			UART_sendByte(READY_TO_SEND); /* inform Control ECU to start sending */
-			sendPasswordViaUART(g_inputPassword);
-			/* inform Control ECU the option that user chose */
-			UART_sendByte('+');
-			/* Control ECU responses [either the password is correct or wrong] */
-			receivedByte = UART_recieveByte();
-			if (receivedByte == UNLOCKING_DOOR) {
-				DoorOpeningTask(); /* start displaying door status on LCD */
-
-			} else if (receivedByte == WRONG_PASSWORD) {
-				LCD_clearScreen();
-				LCD_displayString("Incorrect Pass");
-				_delay_ms(DISPLAY_MESSAGE_DELAY);
-				g_wrongPasswordCounter++;
-				if(g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS )
-				{
-					LCD_clearScreen();
-					while (g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS)
-					{
-						LCD_displayStringRowColumn(0, 5, "WARNING!!");
-						LCD_displayStringRowColumn(1, 0, "Calling Security");
-					}
-				}
-			}
-			appMainOptions(); /* system back to idle & display main options */
-
-
-		} else if (key == '-') {
-			LCD_clearScreen();
-			LCD_displayString("Enter Your Pass");
-			getPassword(g_inputPassword);
-			UART_sendByte(READY_TO_SEND); /* inform Control ECU to start sending */
-			sendPasswordViaUART(g_inputPassword);
-
-			/* inform Control ECU the option that user chose */
-			UART_sendByte(CHANGE_PASSWORD_OPTION);
-
-			receivedByte = UART_recieveByte();
-			if (receivedByte == CHANGING_PASSWORD) {
-				initializePassword();
-				LCD_clearScreen();
-			} else if (receivedByte == WRONG_PASSWORD) {
-				LCD_clearScreen();
-				LCD_displayString("Incorrect Pass");
-				_delay_ms(DISPLAY_MESSAGE_DELAY);
-				g_wrongPasswordCounter++;
-				if(g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS )
-				{
-					LCD_clearScreen();
-					while (g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS)
-					{
-						LCD_displayStringRowColumn(0, 5, "WARNING!!");
-						LCD_displayStringRowColumn(1, 0, "Calling Security");
-					}
-				}
-			}
-			appMainOptions();
+		Supervisor_checkIn(mainLoopTask);
+
+		/* frames of Control ECU are handled as they come */
+		if (PROTOCOL_pollFrame(&frame)) {
+			handleFrame(&frame);
+		} else if (getEvent(&event)) {
+			dispatchEvent(&event);
+		} else {
+			Power_idle(); /* nothing to do till the next interrupt */
 		}
 	}
 }
-
-
-
-
-
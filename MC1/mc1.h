@@ -14,35 +14,125 @@
 #define MC1_H_
 
 #include "std_types.h"
+#include "pt.h"
+#include "protocol.h"
 
 /*******************************************************************************
  *                                Definitions                                  *
  *******************************************************************************/
 #define PASS_SIZE		                      5
-#define KEYPAD_INPUT_DELAY		            500
 #define DOOR_UNLOCKING_PERIOD	             15
 #define DOOR_LEFT_OPEN_PERIOD	              3
 #define DISPLAY_MESSAGE_DELAY	           3000
 /* following definitions used to communicate with Control ECU */
 #define PASSWORD_MATCHED		            1
 #define PASSWORD_MISMATCHED		            0
-#define READY_TO_SEND			           0x15
-#define READY_TO_RECEIVE		           0x16
 #define CHANGE_PASSWORD_OPTION	           0x18
 #define UNLOCKING_DOOR			           0x25
 #define WRONG_PASSWORD			           0x30
 #define CHANGING_PASSWORD		           0X31
+#define PASSWORD_NOT_SET		           0x32  /* Control ECU keeps no password, one has to be set first */
+#define PASSWORD_SET			           0x33  /* Control ECU keeps a password and expects no new one */
+#define PASSWORD_NOT_SAVED		           0x34  /* the passwords match but Control ECU could not store them */
+/* message types of the frames exchanged with Control ECU */
+#define MSG_SET_PASSWORD		           0x01  /* payload: password + confirmation */
+#define MSG_COMMAND				           0x02  /* payload: option + password */
+#define MSG_REPLY				           0x03  /* payload: one response code */
+#define MSG_PROFILE_DUMP		           0x04  /* no payload, asks for the probes table */
+#define MSG_PROFILE_DATA		           0x05  /* payload: one record of the probes table, those of Control ECU are sent on */
+#define MSG_PASSWORD_STATUS		           0x0E  /* no payload, answered with PASSWORD_SET or PASSWORD_NOT_SET */
 
 #define NUMBER_OF_WRONG_PASSWORD_ATTEMPTS 	(3)
 
+/* event loop */
+#define MAIN_LOOP_DEADLINE_MS		        500  /* nothing in the loop waits for Control ECU, a profile dump takes ~200 ms */
+#define EVENT_QUEUE_SIZE		              8  /* events, the queue holds EVENT_QUEUE_SIZE * sizeof(Event) bytes */
+#define REPLY_RETRIES			              3  /* frames sent again before giving up on Control ECU */
+#define ENTER_KEY				             13
+#define NO_REPLY				           0xFF  /* response code standing for a request Control ECU never answered */
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+typedef enum
+{
+	EVENT_KEY,              /* data: pressed key */
+	EVENT_REPLY,            /* data: response code of Control ECU */
+	EVENT_REPLY_TIMEOUT,    /* no reply from Control ECU in time */
+	EVENT_STATE_SECOND,     /* one second of a timed state elapsed */
+	EVENT_KEYPAD_SCAN,      /* time to scan the keypad, and to poll the waiting protothreads */
+	EVENT_BAUD_ACCEPT,      /* data: baud table index Control ECU switched to */
+	EVENT_BAUD_REJECT,      /* data: baud table index Control ECU cannot use */
+	EVENT_LINK_CHECK_ACK    /* Control ECU answered the link check */
+}EventType;
+
+typedef struct
+{
+	EventType type;
+	uint8 data;
+}Event;
+
+typedef enum
+{
+	STATE_SET_PASSWORD, STATE_MAIN_MENU, STATE_ENTER_PASSWORD, STATE_WAIT_REPLY,
+	STATE_MESSAGE, STATE_DOOR_UNLOCKING, STATE_DOOR_OPEN, STATE_DOOR_LOCKING, STATE_LOCKED_OUT
+}AppState;
+
 /*******************************************************************************
  *                      Functions Prototypes                                   *
  *******************************************************************************/
 /*
- * Description: A function to get the password from user and store it in a given array
+ * Description: A function that adds an event to the queue, only called from the Timer1 interrupt
+ * 	(the software timer call-backs) so the queue has a single producer.
+ * 	The event is dropped if the queue is full.
+ * */
+void postEvent(EventType type, uint8 data);
+
+/*
+ * Description: A function that takes the oldest event out of the queue, returns FALSE if it is empty
+ * */
+boolean getEvent(Event * event);
+
+/*
+ * Description: A function that hands an event to the current state, it runs to completion without waiting
  * */
-void getPassword(uint8 * arrayName);
+void dispatchEvent(const Event * event);
 
+/*
+ * Description: A function that moves to a state and shows it on the LCD
+ * */
+void enterState(AppState state);
+
+/*
+ * Description: A protothread that sets a new password: it gets the password and its confirmation from
+ * 	user, sends them to Control ECU and starts over until Control ECU replies they match, or that it
+ * 	keeps its password (it was reset in the middle of a change)
+ * */
+PT_THREAD(setPasswordThread(Protothread * pt, const Event * event));
+
+/*
+ * Description: A function that prepares a request to Control ECU, requestThread sends it when started
+ * */
+void startRequest(uint8 type, const uint8 * payload, uint8 length);
+
+/*
+ * Description: A protothread that sends the prepared request and waits for the reply of Control ECU.
+ * 	If no reply comes in time the frame is sent again at the safe baud rate, up to REPLY_RETRIES times.
+ * 	The response code is left in g_reply, NO_REPLY if Control ECU never answered.
+ * */
+PT_THREAD(requestThread(Protothread * pt, const Event * event));
+
+/*
+ * Description: A protothread that moves both ECUs to the fastest baud rate they can use, starting from
+ * 	the rate in use. Each faster rate is requested, switched to then checked, a rate that gets a reject
+ * 	or no answer within PROTOCOL_REPLY_TIMEOUT_MS falls back to the safe rate and the next slower one is tried.
+ * */
+PT_THREAD(negotiateThread(Protothread * pt, const Event * event));
+
+/*
+ * Description: A function that turns a frame received from Control ECU into an event for the current state
+ * */
+void handleFrame(const PROTOCOL_Frame * frame);
 
 /*
  * Description: A function to display Main options
@@ -50,14 +140,47 @@ void getPassword(uint8 * arrayName);
 void appMainOptions(void);
 
 /*
- * Description: a function to initialize the password
+ * Description: A function that clears the LCD, shows a prompt and starts a new password input
+ * */
+void showPrompt(const char * prompt);
+
+/*
+ * Description: A function that adds a key to the password being typed, returns TRUE once
+ * 	all its digits are typed and Enter is pressed
+ * */
+boolean passwordKey(uint8 key);
+
+/*
+ * Description: A function that handles the response code of Control ECU to a menu option or to the
+ * 	password status asked at start-up
+ * */
+void handleReply(uint8 reply);
+
+/*
+ * Description: A function that counts a wrong password and shows it, locking the panel after too many
+ * */
+void wrongPassword(void);
+
+/*
+ * Description: A function that shows a message for DISPLAY_MESSAGE_DELAY then moves to the next state
+ * */
+void showMessage(const char * message, AppState next);
+
+/*
+ * Description: A function that starts counting down seconds on the state timer
+ * */
+void startCountdown(uint8 seconds);
+
+/*
+ * Description: A function that counts the elapsed seconds of the countdown, returns TRUE when it reaches zero
  * */
-void initializePassword(void);
+boolean countdownElapsed(const Event * event);
 
 /*
- * Description: A function to send the password via UART by looping on sendByte function
+ * Description: A function that scans the keypad and returns a button when it gets pressed, KEYPAD_NO_KEY
+ * 	otherwise. A button has to read the same on two scans in a row and be released before it is reported again
  * */
-void sendPasswordViaUART(uint8 * passwordArray);
+uint8 scanKeypad(void);
 
 /*
  * Description: the call-back function called by the timer every 1 second
@@ -65,8 +188,10 @@ void sendPasswordViaUART(uint8 * passwordArray);
 void timerCallBack(void);
 
 /*
- * Description: A function that displays on LCD that door is opening or closing for a certain period of time
+ * Description: the call-back functions of the keypad scan, state and reply timers, they only post events
  * */
-void DoorOpeningTask(void);
+void keypadScanCallBack(void);
+void stateTimerCallBack(void);
+void replyTimerCallBack(void);
 
 #endif /* MC1_H_ */
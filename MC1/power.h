@@ -0,0 +1,37 @@
+/*******************************************************************************
+ *  [FILE NAME]: power.h
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 17, 2026
+ *
+ *  [DESCRIPTION]: Header file for the tickless idle power management
+ *******************************************************************************/
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include "std_types.h"
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+/*
+ * Description: A function that puts the CPU in idle sleep until the next event, unless one has
+ * 	already been signalled since the last call. Before sleeping the Timer1 clock is stretched to
+ * 	the next software timer deadline so no tick wakes the CPU for nothing.
+ * 	Meant to be called from wait loops: while (!condition) { Power_idle(); }
+ *
+ * Restrictions: - SLEEP_MODE_IDLE is the deepest mode that keeps the UART receiver and Timer1
+ * 				   running on the ATmega16 (power-save needs an asynchronous Timer2 crystal).
+ * 				 - must be called with interrupts enabled.
+ * */
+void Power_idle(void);
+
+/*
+ * Description: A function that records that something happened which a waiting loop may be
+ * 	interested in, called by the interrupts that can end a wait (UART receive, timer expiry).
+ * */
+void Power_signalEvent(void);
+
+#endif /* POWER_H_ */
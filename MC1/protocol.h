@@ -0,0 +1,96 @@
+ /******************************************************************************
+ *
+ * Module: PROTOCOL
+ *
+ * File Name: protocol.h
+ *
+ * Description: Header file for the framed message protocol between the two ECUs
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include "std_types.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+/*
+ * Frame format:
+ * | START | TYPE | LENGTH | PAYLOAD[LENGTH] | CRC-8 |
+ * the CRC-8 covers the TYPE, LENGTH and PAYLOAD bytes.
+ */
+#define PROTOCOL_START_BYTE          0x7E
+#define PROTOCOL_MAX_PAYLOAD         16
+#define PROTOCOL_FRAME_OVERHEAD      4      /* start + type + length + CRC */
+
+/* Time to wait for the reply of the other ECU before the link is considered broken */
+#define PROTOCOL_REPLY_TIMEOUT_MS    200
+
+/*
+ * Link control frames. The requests of the other ECU are answered inside the protocol module,
+ * the answers to our own requests are returned by PROTOCOL_pollFrame like any other frame so
+ * the application can follow a negotiation without waiting for them:
+ * BAUD_REQUEST -> BAUD_ACCEPT, both sides switch, LINK_CHECK -> LINK_CHECK_ACK at the new rate.
+ * After a reject, a missing answer or a failed check the requester calls PROTOCOL_linkFallback.
+ * Application message types must be below PROTOCOL_LINK_MSG_BASE.
+ */
+#define PROTOCOL_LINK_MSG_BASE       0xF0
+#define PROTOCOL_MSG_BAUD_REQUEST    0xF0   /* payload: requested baud table index */
+#define PROTOCOL_MSG_BAUD_ACCEPT     0xF1   /* payload: accepted baud table index */
+#define PROTOCOL_MSG_BAUD_REJECT     0xF2   /* payload: rejected baud table index */
+#define PROTOCOL_MSG_LINK_CHECK      0xF3   /* no payload */
+#define PROTOCOL_MSG_LINK_CHECK_ACK  0xF4   /* no payload */
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+typedef struct
+{
+	uint8 type;
+	uint8 length;
+	uint8 payload[PROTOCOL_MAX_PAYLOAD];
+}PROTOCOL_Frame;
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Build a frame around the given payload and queue it on the UART.
+ */
+void PROTOCOL_sendFrame(uint8 type, const uint8 *payload, uint8 length);
+
+/*
+ * Description :
+ * Feed all received UART bytes to the frame parser without blocking.
+ * Return TRUE and fill frame once a complete frame with a valid CRC has been received,
+ * link control requests of the other ECU are answered here and never returned.
+ */
+boolean PROTOCOL_pollFrame(PROTOCOL_Frame *frame);
+
+/*
+ * Description :
+ * Wait until a complete frame with a valid CRC has been received.
+ */
+void PROTOCOL_receiveFrame(PROTOCOL_Frame *frame);
+
+/*
+ * Description :
+ * Wait up to timeout_ms for a complete frame with a valid CRC.
+ * Return FALSE if no frame has been received in time.
+ */
+boolean PROTOCOL_receiveFrameTimeout(PROTOCOL_Frame *frame, uint16 timeout_ms);
+
+/*
+ * Description :
+ * Return to the safe baud rate and send a break so the other ECU does the same, without waiting.
+ * The transmitter must be idle (UART_isTxComplete), the frames sent meanwhile follow the break.
+ */
+void PROTOCOL_linkFallback(void);
+
+#endif /* PROTOCOL_H_ */
@@ -0,0 +1,109 @@
+ /******************************************************************************
+ *
+ * Module: PT
+ *
+ * File Name: pt.h
+ *
+ * Description: Stackless coroutines (protothreads) for flows that wait on events
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#ifndef PT_H_
+#define PT_H_
+
+#include "std_types.h"
+
+/*
+ * A protothread is a function that can wait in the middle of its body and carry on from there
+ * the next time it is called, so a multi-step flow reads as straight-line code while every call
+ * returns at once. All threads run on the caller's stack: the only state kept between calls is
+ * the 16-bit resume point in the Protothread structure (the line of the last wait).
+ *
+ * Restrictions: - local variables are not kept across a wait, keep them in static or global variables.
+ * 				 - a switch statement must not contain a wait, PT_BEGIN/PT_END are a switch themselves.
+ * 				 - the waits can only be used in the body of the thread function, not in functions it calls,
+ * 				   use PT_SPAWN to run a child thread instead.
+ *
+ * Example:
+ * 	PT_THREAD(blinkThread(Protothread *pt))
+ * 	{
+ * 		PT_BEGIN(pt);
+ * 		while(1)
+ * 		{
+ * 			PT_WAIT_UNTIL(pt, buttonPressed());
+ * 			ledToggle();
+ * 		}
+ * 		PT_END(pt);
+ * 	}
+ * 	...
+ * 	PT_INIT(&g_blinkPt);
+ * 	while(PT_SCHEDULE(blinkThread(&g_blinkPt))) { Power_idle(); }
+ */
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+/* Values returned by a thread function */
+#define PT_WAITING                  0   /* blocked on a condition */
+#define PT_YIELDED                  1   /* gave the CPU up, ready to go on */
+#define PT_EXITED                   2   /* left with PT_EXIT */
+#define PT_ENDED                    3   /* reached PT_END */
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+typedef struct
+{
+	uint16 lc; /* resume point, 0 to start from the beginning */
+}Protothread;
+
+/*******************************************************************************
+ *                                Macros                                       *
+ *******************************************************************************/
+/* Declare a thread function: PT_THREAD(myThread(Protothread *pt, ...)) */
+#define PT_THREAD(DECLARATION)      uint8 DECLARATION
+
+/* (Re)start a thread from the beginning of its body on the next call */
+#define PT_INIT(PT)                 ((PT)->lc = 0)
+
+/* Open and close the body of a thread function */
+#define PT_BEGIN(PT)                { uint8 ptYieldFlag = 1; (void)ptYieldFlag; switch((PT)->lc) { case 0:
+#define PT_END(PT)                  } PT_INIT(PT); return PT_ENDED; }
+
+/* Record the resume point, used by the waits (one wait per line at most) */
+#define PT_LC_SET(PT)               (PT)->lc = __LINE__; case __LINE__:
+
+/* Wait until / while a condition holds, it is checked right away then on every call */
+#define PT_WAIT_UNTIL(PT, CONDITION) \
+	do { PT_LC_SET(PT) if(!(CONDITION)) { return PT_WAITING; } } while(0)
+#define PT_WAIT_WHILE(PT, CONDITION)    PT_WAIT_UNTIL((PT), !(CONDITION))
+
+/* Give the CPU up once */
+#define PT_YIELD(PT) \
+	do { ptYieldFlag = 0; PT_LC_SET(PT) if(ptYieldFlag == 0) { return PT_YIELDED; } } while(0)
+
+/* Give the CPU up once then wait until a condition holds, so the condition is never checked in the current call */
+#define PT_YIELD_UNTIL(PT, CONDITION) \
+	do { ptYieldFlag = 0; PT_LC_SET(PT) if((ptYieldFlag == 0) || !(CONDITION)) { return PT_YIELDED; } } while(0)
+
+/* Wait until a child thread ended, THREAD is the call of the child thread function */
+#define PT_WAIT_THREAD(PT, THREAD)      PT_WAIT_WHILE((PT), PT_SCHEDULE(THREAD))
+
+/* Start a child thread and wait until it ended */
+#define PT_SPAWN(PT, CHILD, THREAD) \
+	do { PT_INIT(CHILD); PT_WAIT_THREAD((PT), (THREAD)); } while(0)
+
+/* Leave the thread, the next call starts it from the beginning */
+#define PT_EXIT(PT) \
+	do { PT_INIT(PT); return PT_EXITED; } while(0)
+
+/* Start the thread again from the beginning on the next call */
+#define PT_RESTART(PT) \
+	do { PT_INIT(PT); return PT_WAITING; } while(0)
+
+/* Run a thread once, TRUE while it has not ended or exited */
+#define PT_SCHEDULE(THREAD)             ((THREAD) < PT_EXITED)
+
+#endif /* PT_H_ */
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ *  [FILE NAME]: supervisor.c
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 17, 2026
+ *
+ *  [DESCRIPTION]: Source file for the watchdog backed task supervisor
+ *******************************************************************************/
+
+#include "supervisor.h"
+#include "sw_timer.h"
+#include "timer.h"
+#include "crc.h"
+#include "common_macros.h"
+#include "avr/io.h"
+#include "avr/interrupt.h"
+#include "avr/wdt.h"
+#include "util/atomic.h" /* For ATOMIC_BLOCK */
+#include <stddef.h> /* For offsetof */
+
+/*******************************************************************************
+ *                           Private Types                                     *
+ *******************************************************************************/
+typedef struct
+{
+	Supervisor_Record record;
+	boolean resetOrdered; /* the supervisor is about to let the watchdog reset the MCU */
+	uint8 crc;            /* CRC-8 of the bytes above, the RAM content is garbage after a power-on */
+}Supervisor_Store;
+
+typedef struct
+{
+	uint16 deadline;
+	uint32 lastCheckIn;
+}Supervisor_Task;
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* Not cleared by the C startup code so it survives watchdog resets */
+static Supervisor_Store g_store __attribute__((section(".noinit")));
+
+static Supervisor_Task g_tasks[SUPERVISOR_MAX_TASKS];
+static uint8 g_taskCount = 0;
+static void (*g_safeStateCallBackPtr)(void) = NULL_PTR;
+static SwTimer g_checkTimer;
+
+/*******************************************************************************
+ *                      Private Functions Prototypes                           *
+ *******************************************************************************/
+static uint8 Supervisor_storeCrc(void);
+static void Supervisor_check(void);
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+void Supervisor_init(void (*safeStateCallBack)(void))
+{
+	uint8 cause = MCUCSR;
+	uint8 task;
+
+	/* the flags add up over resets, clear them so the next reset is told apart */
+	MCUCSR = 0;
+
+	if(BIT_IS_SET(cause,PORF) || (g_store.crc != Supervisor_storeCrc()))
+	{
+		g_store.record.resetCount = 0;
+		g_store.record.watchdogTimeouts = 0;
+		g_store.record.lastMissedTask = SUPERVISOR_NO_TASK;
+		for(task = 0; task < SUPERVISOR_MAX_TASKS; task++)
+		{
+			g_store.record.missCounts[task] = 0;
+		}
+		g_store.resetOrdered = FALSE;
+	}
+	else
+	{
+		g_store.record.resetCount++;
+		if(BIT_IS_SET(cause,WDRF) && !g_store.resetOrdered)
+		{
+			g_store.record.watchdogTimeouts++;
+		}
+	}
+	g_store.record.resetCause = cause;
+	g_store.resetOrdered = FALSE;
+	g_store.crc = Supervisor_storeCrc();
+
+	g_safeStateCallBackPtr = safeStateCallBack;
+	wdt_enable(SUPERVISOR_WATCHDOG_TIMEOUT);
+	SwTimer_start(&g_checkTimer, SUPERVISOR_CHECK_PERIOD_MS, SW_TIMER_PERIODIC, Supervisor_check);
+}
+
+uint8 Supervisor_addTask(uint16 deadline_ms)
+{
+	uint8 task = SUPERVISOR_NO_TASK;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(g_taskCount < SUPERVISOR_MAX_TASKS)
+		{
+			task = g_taskCount;
+			g_tasks[task].deadline = deadline_ms;
+			g_tasks[task].lastCheckIn = Timer_getMillis();
+			g_taskCount++;
+		}
+	}
+	return task;
+}
+
+void Supervisor_checkIn(uint8 task)
+{
+	uint32 now = Timer_getMillis();
+
+	if(task < SUPERVISOR_MAX_TASKS)
+	{
+		/* the check reads the time stamp from the interrupt */
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			g_tasks[task].lastCheckIn = now;
+		}
+	}
+}
+
+void Supervisor_getRecord(Supervisor_Record *record)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*record = g_store.record;
+	}
+}
+
+/*
+ * Description: Software timer call-back, serves the watchdog while every task met its deadline.
+ * 	Otherwise the miss is recorded, the outputs are made safe and the watchdog resets the MCU.
+ * */
+static void Supervisor_check(void)
+{
+	uint32 now = Timer_getMillis();
+	uint8 task;
+
+	for(task = 0; task < g_taskCount; task++)
+	{
+		if((now - g_tasks[task].lastCheckIn) > g_tasks[task].deadline)
+		{
+			g_store.record.missCounts[task]++;
+			g_store.record.lastMissedTask = task;
+			g_store.resetOrdered = TRUE;
+			g_store.crc = Supervisor_storeCrc();
+
+			if(g_safeStateCallBackPtr != NULL_PTR)
+			{
+				g_safeStateCallBackPtr();
+			}
+			/* called from the Timer1 interrupt, nothing runs any more till the reset */
+			wdt_enable(WDTO_15MS);
+			while(1){}
+		}
+	}
+	wdt_reset();
+}
+
+/*
+ * Description: CRC-8 of the stored record, telling it from the random RAM content after a power-on.
+ * */
+static uint8 Supervisor_storeCrc(void)
+{
+	return CRC8_compute((const uint8 *)&g_store, (uint8)offsetof(Supervisor_Store, crc));
+}
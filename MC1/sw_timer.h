@@ -0,0 +1,80 @@
+/*******************************************************************************
+ *  [FILE NAME]: sw_timer.h
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 17, 2026
+ *
+ *  [DESCRIPTION]: Header file for the software timers service running on Timer1
+ *******************************************************************************/
+
+#ifndef SW_TIMER_H_
+#define SW_TIMER_H_
+
+#include "std_types.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+/* Period of the Timer1 monotonic clock interrupt that drives all the software timers */
+#define SW_TIMER_TICK_MS            1
+
+/* Number of slots of the timing wheel (must be a power of two) */
+#define SW_TIMER_WHEEL_SIZE         32
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+typedef enum
+{
+	SW_TIMER_ONE_SHOT,SW_TIMER_PERIODIC
+}SwTimer_mode;
+
+/*
+ * A software timer is owned by the application (usually a global variable) and
+ * linked into the wheel while it is running, so starting one never allocates.
+ */
+typedef struct SwTimer
+{
+	struct SwTimer *next;
+	struct SwTimer *prev;
+	uint32 expiry;              /* tick count at which the timer fires */
+	uint16 period;              /* in ticks, reloaded for periodic timers */
+	SwTimer_mode mode;
+	volatile boolean active;
+	void (*callBackPtr)(void);
+}SwTimer;
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+/*
+ * Description: A function that clears the timing wheel and starts the Timer1 monotonic clock
+ * 	whose millisecond tick drives it.
+ * */
+void SwTimer_init(void);
+
+/*
+ * Description: A function that (re)starts a software timer to fire after period_ms, once or periodically.
+ * 	The call-back function (may be NULL_PTR) is called from the Timer1 interrupt so it must be short.
+ * 	Insertion is O(1): the timer is linked to the wheel slot of its expiry tick.
+ * */
+void SwTimer_start(SwTimer *timer, uint16 period_ms, SwTimer_mode mode, void (*callBackPtr)(void));
+
+/*
+ * Description: A function that stops a software timer in O(1), nothing happens if it is not running.
+ * */
+void SwTimer_cancel(SwTimer *timer);
+
+/*
+ * Description: A function that returns TRUE while the software timer is running.
+ * */
+boolean SwTimer_isActive(const SwTimer *timer);
+
+/*
+ * Description: A function that returns the number of ticks until the earliest running timer expires,
+ * 	or 0xFFFFFFFF if no timer is running. Walks all the running timers, used before going idle.
+ * */
+uint32 SwTimer_ticksToNextExpiry(void);
+
+#endif /* SW_TIMER_H_ */
@@ -19,8 +19,47 @@
 /*******************************************************************************
  *                               Definitions                                   *
  *******************************************************************************/
+/* Safe baud rate both ECUs start at and fall back to when the link degrades */
 #define UART_BAUD_RATE     9600
 
+/* Highest baud rate error accepted for a negotiated rate (in 1/1000) */
+#define UART_MAX_BAUD_ERROR_PERMILLE    20
+
+/* Shortest duration of the break (TX held low) used to force the other ECU back to the safe baud rate */
+#define UART_BREAK_DURATION_MS          2
+
+/*
+ * Baud rates that can be negotiated, in ascending order, the first one must be UART_BAUD_RATE.
+ * Both ECUs must be built with the same table as the rates are exchanged by index.
+ * Every rate must be generated within UART_MAX_BAUD_ERROR_PERMILLE from F_CPU, which is checked
+ * at compile time: at 8 MHz 57600 (2.1 %) and 115200 (3.5 %) are not, so they are left out.
+ */
+#define UART_BAUD_TABLE(ENTRY) \
+	ENTRY(9600)   \
+	ENTRY(19200)  \
+	ENTRY(38400)  \
+	ENTRY(76800)  \
+	ENTRY(250000) \
+	ENTRY(500000)
+
+#define UART_SAFE_BAUD_INDEX            0
+
+/*
+ * UBRR value in double speed mode (U2X = 1) rounded to the nearest integer, the real
+ * baud rate it produces and its error in 1/1000 of the requested rate.
+ * All of them are constant expressions so the table is computed at compile time.
+ */
+#define UART_UBRR_VALUE(BAUD)           ((((F_CPU) + 4UL * (BAUD)) / (8UL * (BAUD))) - 1UL)
+#define UART_REAL_BAUD(BAUD)            ((F_CPU) / (8UL * (UART_UBRR_VALUE(BAUD) + 1UL)))
+#define UART_BAUD_ERROR_PERMILLE(BAUD)  \
+	(((UART_REAL_BAUD(BAUD) > (BAUD)) ? (UART_REAL_BAUD(BAUD) - (BAUD)) : ((BAUD) - UART_REAL_BAUD(BAUD))) * 1000UL / (BAUD))
+
+/* Size of the receive ring buffer filled by the RX complete interrupt (must be a power of two) */
+#define UART_RX_BUFFER_SIZE     32
+
+/* Size of the transmit queue drained by the data register empty interrupt (must be a power of two) */
+#define UART_TX_BUFFER_SIZE     64
+
 
 /*******************************************************************************
  *                               Types Declaration                             *
@@ -47,6 +86,24 @@ typedef struct
 	UART_characterSize size;
 }UART_configType;
 
+typedef struct
+{
+	uint32 baudRate;
+	uint16 ubrr;
+	uint8 errorPermille;
+}UART_baudEntry;
+
+typedef struct
+{
+	uint16 framingErrors;   /* bytes received without a valid stop bit (dropped) */
+	uint16 overrunErrors;   /* bytes lost in hardware because UDR was not read in time */
+	uint16 parityErrors;    /* bytes received with a wrong parity bit (dropped) */
+	uint16 rxDropped;       /* bytes lost because the receive buffer was full */
+	uint32 bytesIn;         /* bytes stored in the receive buffer */
+	uint32 bytesOut;        /* bytes written to the transmitter */
+	uint16 bytesPerSecond;  /* rolling average of bytesIn + bytesOut per second */
+}UART_Stats;
+
 /*******************************************************************************
  *                      Functions Prototypes                                   *
  *******************************************************************************/
@@ -56,22 +113,127 @@ typedef struct
  * Functional responsible for Initialize the UART device by:
  * 1. Setup the Frame format like number of data bits, parity bit type and number of stop bits.
  * 2. Enable the UART.
- * 3. Setup the UART baud rate.
+ * 3. Setup the UART baud rate from its entry in the baud rate table, a rate missing from the
+ *    table is replaced by the safe one so UART_getBaudIndex always tells the rate in use.
  */
 void UART_init(uint32 baud_rate,UART_configType *Config_ptr);
 
 /*
  * Description :
  * Functional responsible for send byte to another UART device.
+ * The byte is queued and sent in the background, blocks only while the transmit queue is full.
  */
 void UART_sendByte(const uint8 data);
 
+/*
+ * Description :
+ * Queue len bytes for transmission and return immediately.
+ * Return FALSE without queuing anything if the transmit queue has no room for the whole buffer.
+ */
+boolean UART_sendBuffer(const uint8 *data, uint8 len);
+
+/*
+ * Description :
+ * Return TRUE when the transmit queue is empty, the last byte has left the shift register
+ * and no break is being sent.
+ */
+boolean UART_isTxComplete(void);
+
+/*
+ * Description :
+ * Wait until every queued byte has been transmitted.
+ */
+void UART_flush(void);
+
+/*
+ * Description :
+ * Set the function called (from interrupt context) once the transmit queue has been completely sent.
+ */
+void UART_setTxCompleteCallBack(void (*a_ptr)(void));
+
+/*
+ * Description :
+ * Return the number of entries in the baud rate table.
+ */
+uint8 UART_getBaudCount(void);
+
+/*
+ * Description :
+ * Return the baud rate table entry of the given index.
+ */
+const UART_baudEntry * UART_getBaudEntry(uint8 index);
+
+/*
+ * Description :
+ * Return TRUE if the baud rate of the given index exists and is within UART_MAX_BAUD_ERROR_PERMILLE.
+ */
+boolean UART_isBaudUsable(uint8 index);
+
+/*
+ * Description :
+ * Switch to the baud rate of the given table index once the queued bytes are sent: at once if
+ * the transmitter is idle, else from the interrupt that sees the last one out.
+ */
+void UART_setBaudIndex(uint8 index);
+
+/*
+ * Description :
+ * Return the table index of the baud rate in use.
+ */
+uint8 UART_getBaudIndex(void);
+
+/*
+ * Description :
+ * Pull the TX line low and return, a software timer releases it after UART_BREAK_DURATION_MS,
+ * which the receiver sees as a break at any baud rate. The bytes queued meanwhile are sent
+ * after the break. Return FALSE without sending it if the transmitter is not idle.
+ */
+boolean UART_sendBreak(void);
+
+/*
+ * Description :
+ * Return TRUE if a break was received since the last call, and clear the indication.
+ */
+boolean UART_breakDetected(void);
+
+/*
+ * Description :
+ * Take a consistent copy of the link health counters.
+ */
+void UART_getStats(UART_Stats *stats);
+
+/*
+ * Description :
+ * Clear all the link health counters.
+ */
+void UART_resetStats(void);
+
+/*
+ * Description :
+ * Update the rolling throughput figure, must be called once every second (e.g. from the 1 second timer call back).
+ */
+void UART_updateThroughput(void);
+
 /*
  * Description :
  * Functional responsible for receive byte from another UART device.
+ * Blocks until a byte is available in the receive buffer.
  */
 uint8 UART_recieveByte(void);
 
+/*
+ * Description :
+ * Return the number of received bytes waiting in the receive buffer.
+ */
+uint8 UART_available(void);
+
+/*
+ * Description :
+ * Take one byte from the receive buffer without blocking.
+ * Return TRUE and store the byte in data if one was available, otherwise return FALSE.
+ */
+boolean UART_tryReceiveByte(uint8 *data);
+
 /*
  * Description :
  * Send the required string through UART to the other UART device.
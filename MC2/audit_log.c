@@ -0,0 +1,270 @@
+/*******************************************************************************
+ *  [FILE NAME]: audit_log.c
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 18, 2026
+ *
+ *  [DESCRIPTION]: Source file for the circular access audit log on the external EEPROM
+ *******************************************************************************/
+
+#include "audit_log.h"
+#include "crc.h"
+#include "timer.h"
+#include "protocol.h"
+#include "spsc_queue.h"
+
+/*******************************************************************************
+ *                           Private Definitions                               *
+ *******************************************************************************/
+/* Layout of an entry */
+#define AUDIT_SEQ_LOW       0
+#define AUDIT_SEQ_HIGH      1
+#define AUDIT_TIME          2
+#define AUDIT_EVENT_RESULT  6
+#define AUDIT_CRC           (AUDIT_LOG_ENTRY_SIZE - 1)
+
+#define AUDIT_LOG_START_ADDRESS  ((uint16)AUDIT_LOG_FIRST_PAGE * EEPROM_PAGE_SIZE)
+
+/* Whole entries in one frame */
+#define AUDIT_ENTRIES_PER_FRAME  (PROTOCOL_MAX_PAYLOAD / AUDIT_LOG_ENTRY_SIZE)
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+static uint8 g_head = 0;    /* slot the next entry goes to */
+static uint8 g_count = 0;   /* entries in the log, the oldest is g_count slots before g_head */
+static uint16 g_seq = 0;    /* sequence number of the newest entry */
+static uint16 g_dropped = 0;
+
+/* Entries appended but not written yet, without their sequence number and CRC */
+static uint8 g_pendingBuffer[AUDIT_LOG_PENDING * AUDIT_LOG_ENTRY_SIZE];
+static SpscQueue g_pending = SPSC_QUEUE_INITIALIZER(g_pendingBuffer);
+
+/*******************************************************************************
+ *                      Private Functions Prototypes                           *
+ *******************************************************************************/
+static uint16 AuditLog_slotAddress(uint8 slot);
+static boolean AuditLog_isValid(const uint8 *entry);
+static boolean AuditLog_readEntry(uint8 slot, uint8 *entry);
+static uint16 AuditLog_getSeq(const uint8 *entry);
+static boolean AuditLog_isInLap(uint8 slot, uint16 firstSeq);
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+void AuditLog_init(void)
+{
+	uint8 entry[AUDIT_LOG_ENTRY_SIZE];
+	uint16 firstSeq;
+	uint8 low;
+	uint8 high;
+	uint8 middle;
+
+	g_head = 0;
+	g_count = 0;
+	g_seq = 0;
+
+	if(!AuditLog_readEntry(0, entry))
+	{
+		/* empty, unless the write that started a new lap on slot 0 was cut by a reset */
+		if(AuditLog_readEntry(AUDIT_LOG_ENTRIES - 1, entry))
+		{
+			g_seq = AuditLog_getSeq(entry);
+			g_count = AUDIT_LOG_ENTRIES - 1;
+		}
+		return;
+	}
+
+	/*
+	 * The slots from 0 hold the entries of the current lap with consecutive sequence numbers,
+	 * the ones after them older entries or nothing: binary search for the last slot of the lap.
+	 * Slot low is always in the lap, slot high never (AUDIT_LOG_ENTRIES stands for past the end).
+	 */
+	firstSeq = AuditLog_getSeq(entry);
+	low = 0;
+	high = AUDIT_LOG_ENTRIES;
+	while((uint8)(high - low) > 1)
+	{
+		middle = low + (uint8)(high - low) / 2;
+		if(AuditLog_isInLap(middle, firstSeq))
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	g_seq = firstSeq + low;
+	g_head = (uint8)(low + 1) % AUDIT_LOG_ENTRIES;
+	/* the log has wrapped if the last slot holds the entry just before slot 0 */
+	if((low == AUDIT_LOG_ENTRIES - 1) ||
+			(AuditLog_readEntry(AUDIT_LOG_ENTRIES - 1, entry) && (AuditLog_getSeq(entry) == (uint16)(firstSeq - 1))))
+	{
+		g_count = AUDIT_LOG_ENTRIES;
+	}
+	else
+	{
+		g_count = low + 1;
+	}
+}
+
+boolean AuditLog_append(uint8 event, uint8 result)
+{
+	uint8 entry[AUDIT_LOG_ENTRY_SIZE];
+	uint32 time = Timer_getMillis();
+	uint8 i;
+
+	for(i = 0; i < 4; i++)
+	{
+		entry[AUDIT_TIME + i] = (uint8)(time >> (8 * i));
+	}
+	entry[AUDIT_EVENT_RESULT] = (uint8)((event << 4) | (result & 0x0F));
+
+	if(!SpscQueue_write(&g_pending, entry, AUDIT_LOG_ENTRY_SIZE))
+	{
+		g_dropped++;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void AuditLog_flush(void)
+{
+	uint8 entry[AUDIT_LOG_ENTRY_SIZE];
+	uint16 seq;
+
+	while(SpscQueue_read(&g_pending, entry, AUDIT_LOG_ENTRY_SIZE))
+	{
+		seq = g_seq + 1;
+		entry[AUDIT_SEQ_LOW] = (uint8)seq;
+		entry[AUDIT_SEQ_HIGH] = (uint8)(seq >> 8);
+		entry[AUDIT_CRC] = CRC8_computeFrom(CRC8_STORAGE_INITIAL_VALUE, entry, AUDIT_CRC);
+
+		/*
+		 * An entry never crosses a page and replaces the oldest one when the log is full. It is
+		 * written behind, the two entries of a page mostly go in one write cycle for half the
+		 * wear. The cache keeps the order of the writes: the entries reach the EEPROM in sequence
+		 * order, a reset loses the newest ones but never leaves a hole behind the head for the
+		 * binary search in AuditLog_init.
+		 */
+		if(EEPROM_writeBehind(AuditLog_slotAddress(g_head), entry, AUDIT_LOG_ENTRY_SIZE) == ERROR)
+		{
+			g_dropped++;
+			continue;
+		}
+		g_seq = seq;
+		g_head = (uint8)(g_head + 1) % AUDIT_LOG_ENTRIES;
+		if(g_count < AUDIT_LOG_ENTRIES)
+		{
+			g_count++;
+		}
+	}
+}
+
+void AuditLog_export(uint8 count, uint8 frameType)
+{
+	uint8 buffer[AUDIT_ENTRIES_PER_FRAME * AUDIT_LOG_ENTRY_SIZE];
+	uint8 payload[AUDIT_ENTRIES_PER_FRAME * AUDIT_LOG_ENTRY_SIZE];
+	uint8 slot;
+	uint8 chunk;
+	uint8 length;
+	uint8 i;
+	uint8 j;
+
+	AuditLog_flush();
+	if(count > g_count)
+	{
+		count = g_count;
+	}
+	slot = (uint8)(g_head + AUDIT_LOG_ENTRIES - count) % AUDIT_LOG_ENTRIES;
+
+	while(count != 0)
+	{
+		/* one sequential read per frame, split only where the log wraps round */
+		chunk = AUDIT_ENTRIES_PER_FRAME;
+		if(chunk > count)
+		{
+			chunk = count;
+		}
+		if(chunk > AUDIT_LOG_ENTRIES - slot)
+		{
+			chunk = AUDIT_LOG_ENTRIES - slot;
+		}
+
+		length = 0;
+		if(EEPROM_readBuffer(AuditLog_slotAddress(slot), buffer, chunk * AUDIT_LOG_ENTRY_SIZE) == SUCCESS)
+		{
+			/* entries that do not pass their CRC any more are left out */
+			for(i = 0; i < chunk * AUDIT_LOG_ENTRY_SIZE; i += AUDIT_LOG_ENTRY_SIZE)
+			{
+				if(AuditLog_isValid(buffer + i))
+				{
+					for(j = 0; j < AUDIT_LOG_ENTRY_SIZE; j++)
+					{
+						payload[length++] = buffer[i + j];
+					}
+				}
+			}
+		}
+		if(length != 0)
+		{
+			PROTOCOL_sendFrame(frameType, payload, length);
+		}
+
+		slot = (uint8)(slot + chunk) % AUDIT_LOG_ENTRIES;
+		count -= chunk;
+	}
+	PROTOCOL_sendFrame(frameType, NULL_PTR, 0);
+}
+
+uint8 AuditLog_getCount(void)
+{
+	return g_count;
+}
+
+uint16 AuditLog_getDropped(void)
+{
+	return g_dropped;
+}
+
+/*
+ * Description :
+ * EEPROM address of a log slot.
+ */
+static uint16 AuditLog_slotAddress(uint8 slot)
+{
+	return AUDIT_LOG_START_ADDRESS + (uint16)slot * AUDIT_LOG_ENTRY_SIZE;
+}
+
+static boolean AuditLog_isValid(const uint8 *entry)
+{
+	return CRC8_computeFrom(CRC8_STORAGE_INITIAL_VALUE, entry, AUDIT_CRC) == entry[AUDIT_CRC];
+}
+
+/*
+ * Description :
+ * Read a slot, return TRUE if it holds a valid entry.
+ */
+static boolean AuditLog_readEntry(uint8 slot, uint8 *entry)
+{
+	return (EEPROM_readBuffer(AuditLog_slotAddress(slot), entry, AUDIT_LOG_ENTRY_SIZE) == SUCCESS) && AuditLog_isValid(entry);
+}
+
+static uint16 AuditLog_getSeq(const uint8 *entry)
+{
+	return entry[AUDIT_SEQ_LOW] | ((uint16)entry[AUDIT_SEQ_HIGH] << 8);
+}
+
+/*
+ * Description :
+ * Tell if a slot holds an entry of the lap that starts with firstSeq on slot 0.
+ */
+static boolean AuditLog_isInLap(uint8 slot, uint16 firstSeq)
+{
+	uint8 entry[AUDIT_LOG_ENTRY_SIZE];
+
+	return AuditLog_readEntry(slot, entry) && (AuditLog_getSeq(entry) == (uint16)(firstSeq + slot));
+}
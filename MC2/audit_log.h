@@ -0,0 +1,79 @@
+/*******************************************************************************
+ *  [FILE NAME]: audit_log.h
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 18, 2026
+ *
+ *  [DESCRIPTION]: Header file for the circular access audit log on the external EEPROM
+ *******************************************************************************/
+
+#ifndef AUDIT_LOG_H_
+#define AUDIT_LOG_H_
+
+#include "std_types.h"
+#include "external_eeprom.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+/* EEPROM pages of the log, above the record store */
+#define AUDIT_LOG_FIRST_PAGE            64
+#define AUDIT_LOG_PAGES                 64
+
+/*
+ * An entry: sequence number (2 bytes), time in ms since boot (4 bytes), event in the high
+ * nibble and result in the low nibble, CRC-8 of the first 7 bytes seeded with
+ * CRC8_STORAGE_INITIAL_VALUE. Multi-byte fields are LSB first.
+ * The time starts again from 0 at every MC2 reset and there is no real-time clock: the
+ * sequence number orders the entries, the times compare only between entries of one boot,
+ * which starts with the entry logged at boot (AUDIT_EVENT_BOOT in mc2.h).
+ */
+#define AUDIT_LOG_ENTRY_SIZE            8
+#define AUDIT_LOG_ENTRIES               (AUDIT_LOG_PAGES * EEPROM_PAGE_SIZE / AUDIT_LOG_ENTRY_SIZE)
+
+/* Entries waiting in RAM for AuditLog_flush, a power of two */
+#define AUDIT_LOG_PENDING               4
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+/*
+ * Description: A function that finds the newest and the oldest entries of the log with a binary
+ * 	search over the sequence numbers, O(log n) EEPROM reads instead of a scan.
+ *
+ * Restrictions: - must be called after TWI_init, with the interrupts enabled.
+ * */
+void AuditLog_init(void);
+
+/*
+ * Description: A function that timestamps an entry and queues it in RAM, it does not touch the
+ * 	EEPROM so it costs nothing on the path that reports the event. Returns FALSE (and counts
+ * 	the entry as dropped) if AUDIT_LOG_PENDING entries are already waiting.
+ * */
+boolean AuditLog_append(uint8 event, uint8 result);
+
+/*
+ * Description: A function that writes the queued entries to the EEPROM write-behind cache, to be
+ * 	called when the application has nothing more urgent to do, before EEPROM_service.
+ * */
+void AuditLog_flush(void);
+
+/*
+ * Description: A function that sends the newest count entries, oldest first, in frames of the
+ * 	given type holding whole entries, then an empty frame of that type to end the export.
+ * */
+void AuditLog_export(uint8 count, uint8 frameType);
+
+/*
+ * Description: A function that returns the number of entries in the log.
+ * */
+uint8 AuditLog_getCount(void);
+
+/*
+ * Description: A function that returns the number of entries lost because the RAM queue was full or
+ * 	the EEPROM failed.
+ * */
+uint16 AuditLog_getDropped(void);
+
+#endif /* AUDIT_LOG_H_ */
@@ -11,72 +11,421 @@
  *******************************************************************************/
 #include "external_eeprom.h"
 #include "twi.h"
+#include "power.h" /* To sleep while waiting for the bus */
+#include "timer.h" /* To bound the wait for the write cycle */
+#include "sw_timer.h" /* To back off before a retry */
 
+/*******************************************************************************
+ *                           Private Types                                     *
+ *******************************************************************************/
+/* A page of the write-behind cache */
+typedef struct
+{
+	uint8 page;
+	uint16 dirtyMask;   /* bit i set: data[i] is newer than the EEPROM */
+	uint16 firstWrite;  /* ms clock (low 16 bits) of the first and the last update of the page */
+	uint16 lastWrite;
+	uint8 data[EEPROM_PAGE_SIZE];
+}EEPROM_CachePage;
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+static EEPROM_ErrorCounters g_errors = {0, 0};
+static SwTimer g_backoffTimer;
+
+/* The cached pages in the order of their first update, g_cacheCount of them from g_cacheFirst */
+static EEPROM_CachePage g_cache[EEPROM_CACHE_PAGES];
+static uint8 g_cacheFirst = 0;
+static uint8 g_cacheCount = 0;
+static SwTimer g_flushTimer; /* wakes the main loop when a cached page is due */
+
+/*******************************************************************************
+ *                      Private Functions Prototypes                           *
+ *******************************************************************************/
+static uint8 EEPROM_run(TWI_Transaction *transaction);
+static uint8 EEPROM_runOnce(TWI_Transaction *transaction);
+static uint8 EEPROM_waitWriteCycle(uint16 u16addr);
+static uint8 EEPROM_writeDevice(uint16 u16addr, const uint8 *data, uint16 length);
+static uint8 EEPROM_readDevice(uint16 u16addr, uint8 *data, uint16 length);
+static EEPROM_CachePage *EEPROM_cacheSlot(uint8 index);
+static uint8 EEPROM_writeOldestPage(void);
+static void EEPROM_startFlushTimer(void);
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
 uint8 EEPROM_writeByte(uint16 u16addr, uint8 u8data)
 {
-	/* Send the Start Bit */
-    TWI_start();
-    if (TWI_getStatus() != TWI_START)
-        return ERROR;
-		
-    /* Send the device address, we need to get A8 A9 A10 address bits from the
-     * memory location address and R/W=0 (write) */
-    TWI_writeByte((uint8)(0xA0 | ((u16addr & 0x0700)>>7)));
-    if (TWI_getStatus() != TWI_MT_SLA_W_ACK)
-        return ERROR; 
-		 
-    /* Send the required memory location address */
-    TWI_writeByte((uint8)(u16addr));
-    if (TWI_getStatus() != TWI_MT_DATA_ACK)
-        return ERROR;
-		
-    /* write byte to eeprom */
-    TWI_writeByte(u8data);
-    if (TWI_getStatus() != TWI_MT_DATA_ACK)
-        return ERROR;
-
-    /* Send the Stop Bit */
-    TWI_stop();
-	
-    return SUCCESS;
+	return EEPROM_writeBuffer(u16addr, &u8data, 1);
+}
+
+uint8 EEPROM_writeBuffer(uint16 u16addr, const uint8 *data, uint16 length)
+{
+	/* the cached updates were made first, they reach the EEPROM first */
+	if(EEPROM_flush() == ERROR)
+	{
+		return ERROR;
+	}
+	return EEPROM_writeDevice(u16addr, data, length);
 }
 
 uint8 EEPROM_readByte(uint16 u16addr, uint8 *u8data)
 {
-	/* Send the Start Bit */
-    TWI_start();
-    if (TWI_getStatus() != TWI_START)
-        return ERROR;
-		
-    /* Send the device address, we need to get A8 A9 A10 address bits from the
-     * memory location address and R/W=0 (write) */
-    TWI_writeByte((uint8)((0xA0) | ((u16addr & 0x0700)>>7)));
-    if (TWI_getStatus() != TWI_MT_SLA_W_ACK)
-        return ERROR;
-		
-    /* Send the required memory location address */
-    TWI_writeByte((uint8)(u16addr));
-    if (TWI_getStatus() != TWI_MT_DATA_ACK)
-        return ERROR;
-		
-    /* Send the Repeated Start Bit */
-    TWI_start();
-    if (TWI_getStatus() != TWI_REP_START)
-        return ERROR;
-		
-    /* Send the device address, we need to get A8 A9 A10 address bits from the
-     * memory location address and R/W=1 (Read) */
-    TWI_writeByte((uint8)((0xA0) | ((u16addr & 0x0700)>>7) | 1));
-    if (TWI_getStatus() != TWI_MT_SLA_R_ACK)
-        return ERROR;
-
-    /* Read Byte from Memory without send ACK */
-    *u8data = TWI_readByteWithNACK();
-    if (TWI_getStatus() != TWI_MR_DATA_NACK)
-        return ERROR;
-
-    /* Send the Stop Bit */
-    TWI_stop();
-
-    return SUCCESS;
+	return EEPROM_readBuffer(u16addr, u8data, 1);
+}
+
+uint8 EEPROM_readBuffer(uint16 u16addr, uint8 *data, uint16 length)
+{
+	EEPROM_CachePage *cachePage;
+	uint8 index;
+	uint16 i;
+
+	if(EEPROM_readDevice(u16addr, data, length) == ERROR)
+	{
+		return ERROR;
+	}
+	/* the cached updates not written yet are the current data */
+	for(index = 0; index < g_cacheCount; index++)
+	{
+		cachePage = EEPROM_cacheSlot(index);
+		for(i = 0; i < length; i++)
+		{
+			if(((uint8)((u16addr + i) / EEPROM_PAGE_SIZE) == cachePage->page) &&
+					(cachePage->dirtyMask & (1U << ((u16addr + i) % EEPROM_PAGE_SIZE))))
+			{
+				data[i] = cachePage->data[(u16addr + i) % EEPROM_PAGE_SIZE];
+			}
+		}
+	}
+	return SUCCESS;
+}
+
+uint8 EEPROM_writeBehind(uint16 u16addr, const uint8 *data, uint16 length)
+{
+	EEPROM_CachePage *cachePage;
+	uint16 now = (uint16)Timer_getMillis();
+	uint8 page;
+	uint8 offset;
+
+	for(; length != 0; u16addr++, data++, length--)
+	{
+		page = (uint8)(u16addr / EEPROM_PAGE_SIZE);
+		offset = (uint8)(u16addr % EEPROM_PAGE_SIZE);
+
+		if((g_cacheCount == 0) || (EEPROM_cacheSlot(g_cacheCount - 1)->page != page))
+		{
+			/*
+			 * Only the newest page takes more updates, an older one would carry them ahead of the
+			 * pages updated since: the page goes in again as the newest, after the oldest page is
+			 * written if the cache is full. The reads take the cached pages oldest first.
+			 */
+			if((g_cacheCount == EEPROM_CACHE_PAGES) && (EEPROM_writeOldestPage() == ERROR))
+			{
+				return ERROR;
+			}
+			cachePage = EEPROM_cacheSlot(g_cacheCount);
+			g_cacheCount++;
+			cachePage->page = page;
+			cachePage->dirtyMask = 0;
+			cachePage->firstWrite = now;
+		}
+
+		cachePage = EEPROM_cacheSlot(g_cacheCount - 1);
+		cachePage->data[offset] = *data;
+		cachePage->dirtyMask |= (uint16)(1U << offset);
+		cachePage->lastWrite = now;
+	}
+	EEPROM_startFlushTimer();
+	return SUCCESS;
+}
+
+void EEPROM_service(void)
+{
+	uint16 now = (uint16)Timer_getMillis();
+	EEPROM_CachePage *oldest;
+
+	/*
+	 * The oldest page is due first, the newer ones were first updated after its last update.
+	 * A newer page that is due anyway, behind an oldest page that failed, waits for it.
+	 */
+	while(g_cacheCount != 0)
+	{
+		oldest = EEPROM_cacheSlot(0);
+		if(((uint16)(now - oldest->lastWrite) < EEPROM_CACHE_IDLE_MS) &&
+				((uint16)(now - oldest->firstWrite) < EEPROM_CACHE_DEADLINE_MS))
+		{
+			break;
+		}
+		if(EEPROM_writeOldestPage() == ERROR)
+		{
+			/* the EEPROM does not answer, try again later rather than at every pass */
+			oldest->firstWrite = now;
+			oldest->lastWrite = now;
+			break;
+		}
+	}
+	EEPROM_startFlushTimer();
+}
+
+uint8 EEPROM_flush(void)
+{
+	uint8 status = SUCCESS;
+
+	while(g_cacheCount != 0)
+	{
+		status = EEPROM_writeOldestPage();
+		if(status == ERROR)
+		{
+			break;
+		}
+	}
+	EEPROM_startFlushTimer();
+	return status;
+}
+
+void EEPROM_getErrorCounters(EEPROM_ErrorCounters *counters)
+{
+	*counters = g_errors;
+}
+
+/*
+ * Description :
+ * Write the data to the EEPROM page by page, waiting for each write cycle.
+ */
+static uint8 EEPROM_writeDevice(uint16 u16addr, const uint8 *data, uint16 length)
+{
+	TWI_Transaction transaction;
+	uint8 message[EEPROM_PAGE_SIZE + 1];
+	uint8 count;
+	uint8 i;
+
+	while(length != 0)
+	{
+		/* up to the end of the page holding u16addr, the EEPROM wraps around inside a page */
+		count = (uint8)(EEPROM_PAGE_SIZE - (u16addr % EEPROM_PAGE_SIZE));
+		if(count > length)
+		{
+			count = (uint8)length;
+		}
+
+		/* the word address then the data bytes */
+		message[0] = (uint8)u16addr;
+		for(i = 0; i < count; i++)
+		{
+			message[i + 1] = data[i];
+		}
+
+		transaction.slaveAddress = EEPROM_SLAVE_ADDRESS(u16addr);
+		transaction.writeData = message;
+		transaction.writeLength = (uint8)(count + 1);
+		transaction.readLength = 0;
+		if((EEPROM_run(&transaction) == ERROR) || (EEPROM_waitWriteCycle(u16addr) == ERROR))
+		{
+			return ERROR;
+		}
+
+		u16addr += count;
+		data += count;
+		length -= count;
+	}
+	return SUCCESS;
+}
+
+/*
+ * Description :
+ * Read the data from the EEPROM with sequential reads.
+ */
+static uint8 EEPROM_readDevice(uint16 u16addr, uint8 *data, uint16 length)
+{
+	TWI_Transaction transaction;
+	uint8 wordAddress;
+	uint16 count;
+
+	while(length != 0)
+	{
+		/* up to the end of the block holding u16addr, and no more than a transaction can read */
+		count = 256 - (u16addr & 0xFF);
+		if(count > length)
+		{
+			count = length;
+		}
+		if(count > 0xFF)
+		{
+			count = 0xFF;
+		}
+
+		/* set the word address then read from it after a repeated start */
+		wordAddress = (uint8)u16addr;
+		transaction.slaveAddress = EEPROM_SLAVE_ADDRESS(u16addr);
+		transaction.writeData = &wordAddress;
+		transaction.writeLength = 1;
+		transaction.readData = data;
+		transaction.readLength = (uint8)count;
+		if(EEPROM_run(&transaction) == ERROR)
+		{
+			return ERROR;
+		}
+
+		u16addr += count;
+		data += count;
+		length -= count;
+	}
+	return SUCCESS;
+}
+
+/*
+ * Description :
+ * Run a transaction, trying it again with a growing back-off if it fails: a glitch on the
+ * line or a bus the driver had to clear usually works the next time.
+ */
+static uint8 EEPROM_run(TWI_Transaction *transaction)
+{
+	uint8 attempt;
+
+	for(attempt = 0; EEPROM_runOnce(transaction) == ERROR; attempt++)
+	{
+		if(attempt == EEPROM_RETRIES)
+		{
+			g_errors.failures++;
+			return ERROR;
+		}
+		g_errors.retries++;
+		SwTimer_start(&g_backoffTimer, (uint16)(EEPROM_BACKOFF_MS << attempt), SW_TIMER_ONE_SHOT, NULL_PTR);
+		while(SwTimer_isActive(&g_backoffTimer))
+		{
+			Power_idle();
+		}
+	}
+	return SUCCESS;
+}
+
+/*
+ * Description :
+ * Run a transaction on the TWI engine and sleep till it is over, the engine times it out.
+ */
+static uint8 EEPROM_runOnce(TWI_Transaction *transaction)
+{
+	transaction->callBackPtr = NULL_PTR;
+	while(!TWI_submit(transaction))
+	{
+		Power_idle(); /* the queue is full, wait for a transaction to end */
+	}
+	while((transaction->status != TWI_TRANSACTION_DONE) && (transaction->status != TWI_TRANSACTION_FAILED))
+	{
+		Power_idle();
+	}
+	return (transaction->status == TWI_TRANSACTION_DONE) ? SUCCESS : ERROR;
+}
+
+/*
+ * Description :
+ * Acknowledge polling: the EEPROM ignores its address during its internal write cycle, so
+ * address it with an empty write till it acknowledges. The NACKs are expected, no retries.
+ */
+static uint8 EEPROM_waitWriteCycle(uint16 u16addr)
+{
+	TWI_Transaction poll;
+	uint32 start = Timer_getMillis();
+
+	poll.slaveAddress = EEPROM_SLAVE_ADDRESS(u16addr);
+	poll.writeLength = 0;
+	poll.readLength = 0;
+	while(EEPROM_runOnce(&poll) == ERROR)
+	{
+		if((uint32)(Timer_getMillis() - start) > EEPROM_WRITE_CYCLE_TIMEOUT_MS)
+		{
+			return ERROR;
+		}
+	}
+	return SUCCESS;
+}
+
+/*
+ * Description :
+ * Cached page number index in the order of the first updates, 0 is the oldest.
+ */
+static EEPROM_CachePage *EEPROM_cacheSlot(uint8 index)
+{
+	return &g_cache[(uint8)(g_cacheFirst + index) % EEPROM_CACHE_PAGES];
+}
+
+/*
+ * Description :
+ * Write the dirty bytes of the oldest cached page in one write cycle and take it out of the
+ * cache. The bytes between two dirty ones are read back first so the write can cover them.
+ * If the write fails the page stays the oldest one.
+ */
+static uint8 EEPROM_writeOldestPage(void)
+{
+	EEPROM_CachePage *cachePage = EEPROM_cacheSlot(0);
+	uint8 buffer[EEPROM_PAGE_SIZE];
+	uint16 address = (uint16)cachePage->page * EEPROM_PAGE_SIZE;
+	uint8 first = 0;
+	uint8 last = EEPROM_PAGE_SIZE - 1;
+	uint8 i;
+
+	if(g_cacheCount == 0)
+	{
+		return SUCCESS;
+	}
+	while(!(cachePage->dirtyMask & (1U << first)))
+	{
+		first++;
+	}
+	while(!(cachePage->dirtyMask & (1U << last)))
+	{
+		last--;
+	}
+
+	if(EEPROM_readDevice(address + first, buffer + first, (uint8)(last - first + 1)) == ERROR)
+	{
+		return ERROR;
+	}
+	for(i = first; i <= last; i++)
+	{
+		if(cachePage->dirtyMask & (1U << i))
+		{
+			buffer[i] = cachePage->data[i];
+		}
+	}
+	if(EEPROM_writeDevice(address + first, buffer + first, (uint8)(last - first + 1)) == ERROR)
+	{
+		return ERROR;
+	}
+	g_cacheFirst = (uint8)(g_cacheFirst + 1) % EEPROM_CACHE_PAGES;
+	g_cacheCount--;
+	return SUCCESS;
+}
+
+/*
+ * Description :
+ * Set the flush timer to the time the oldest cached page is due, it only has to wake the main loop.
+ */
+static void EEPROM_startFlushTimer(void)
+{
+	uint16 now = (uint16)Timer_getMillis();
+	EEPROM_CachePage *oldest = EEPROM_cacheSlot(0);
+	uint16 quiet;
+	uint16 age;
+	uint16 due;
+
+	if(g_cacheCount == 0)
+	{
+		SwTimer_cancel(&g_flushTimer);
+		return;
+	}
+
+	quiet = (uint16)(now - oldest->lastWrite);
+	age = (uint16)(now - oldest->firstWrite);
+	due = (quiet >= EEPROM_CACHE_IDLE_MS) ? 0 : (EEPROM_CACHE_IDLE_MS - quiet);
+	if(age >= EEPROM_CACHE_DEADLINE_MS)
+	{
+		due = 0;
+	}
+	else if(EEPROM_CACHE_DEADLINE_MS - age < due)
+	{
+		due = EEPROM_CACHE_DEADLINE_MS - age;
+	}
+	SwTimer_start(&g_flushTimer, (due == 0) ? 1 : due, SW_TIMER_ONE_SHOT, NULL_PTR);
 }
@@ -22,11 +22,91 @@
 #define ERROR 0
 #define SUCCESS 1
 
+/* 24C16: the 7-bit slave address carries the address bits A8 A9 A10 */
+#define EEPROM_SLAVE_ADDRESS(ADDR)  ((uint8)(0x50 | (((ADDR) >> 8) & 0x07)))
+
+/* 24C16 page: one write transaction must not cross a page boundary */
+#define EEPROM_PAGE_SIZE             16
+
+/* Longest internal write cycle (5ms on the 24C16) with a margin, before giving up polling */
+#define EEPROM_WRITE_CYCLE_TIMEOUT_MS 10
+
+/* A failed transaction is tried again EEPROM_RETRIES times, after 1, 2, 4... x EEPROM_BACKOFF_MS */
+#define EEPROM_RETRIES               3
+#define EEPROM_BACKOFF_MS            1
+
+/* Write-behind cache: pages held in RAM, written once quiet for IDLE_MS or cached for DEADLINE_MS */
+#define EEPROM_CACHE_PAGES           4
+#define EEPROM_CACHE_IDLE_MS         50
+#define EEPROM_CACHE_DEADLINE_MS     1000
+
+/*******************************************************************************
+ *                         Types Declaration                                   *
+ *******************************************************************************/
+typedef struct{
+	uint16 retries;     /* transactions tried again */
+	uint16 failures;    /* transactions given up after all the retries */
+}EEPROM_ErrorCounters;
+
 /*******************************************************************************
  *                      Functions Prototypes                                   *
  *******************************************************************************/
 
 uint8 EEPROM_writeByte(uint16 u16addr,uint8 u8data);
 uint8 EEPROM_readByte(uint16 u16addr,uint8 *u8data);
+
+/*
+ * Description :
+ * Write length bytes starting at u16addr, one page write per EEPROM page they touch.
+ * After each page the EEPROM is polled with its address till it acknowledges, that is till
+ * its internal write cycle is over, so the data is stored when the function returns.
+ * The pages cached by EEPROM_writeBehind are written first, as their updates came first.
+ * Return ERROR if a transaction fails or the EEPROM stays busy longer than
+ * EEPROM_WRITE_CYCLE_TIMEOUT_MS, nothing of the data is written if a cached page failed.
+ */
+uint8 EEPROM_writeBuffer(uint16 u16addr, const uint8 *data, uint16 length);
+
+/*
+ * Description :
+ * Read length bytes starting at u16addr with sequential reads: the memory address is sent
+ * once, then the bytes follow each other, acknowledged by the master but the last one.
+ * A read is split only where it crosses a 256-byte block, as the block is part of the
+ * slave address.
+ */
+uint8 EEPROM_readBuffer(uint16 u16addr, uint8 *data, uint16 length);
+
+/*
+ * Description :
+ * Write-behind: update the data in a RAM copy of its pages and return, EEPROM_service writes the
+ * pages later, all the updates a page got in the meantime in one write cycle.
+ * The pages are written in the order of their first update, and a page takes more updates only
+ * while it is the newest one, else it is cached again as the newest. So the writes reach the
+ * EEPROM in the order they were made and a reset only loses the newest ones.
+ * When all the EEPROM_CACHE_PAGES are taken the oldest one is written first to make room.
+ * EEPROM_readBuffer sees the cached data.
+ * Return ERROR if a page had to be written first and that failed, the data is not cached then.
+ */
+uint8 EEPROM_writeBehind(uint16 u16addr, const uint8 *data, uint16 length);
+
+/*
+ * Description :
+ * Write the cached pages that are due, to be called from the main loop when it is idle.
+ * A software timer wakes the loop from Power_idle when the next page is due.
+ */
+void EEPROM_service(void);
+
+/*
+ * Description :
+ * Write all the cached pages now, oldest first, before anything that could cut the power or must
+ * not be disturbed by a write cycle. Return ERROR if a page could not be written, it and the
+ * newer ones stay cached.
+ */
+uint8 EEPROM_flush(void);
+
+/*
+ * Description :
+ * Copy the retry and failure counters, the bus faults behind them are in TWI_getErrorCounters.
+ */
+void EEPROM_getErrorCounters(EEPROM_ErrorCounters *counters);
  
 #endif /* EXTERNAL_EEPROM_H_ */
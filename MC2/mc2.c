@@ -9,29 +9,47 @@
  *******************************************************************************/
 #define F_CPU 8000000UL
 #include "uart.h"
+#include "protocol.h"
 #include "std_types.h"
 #include "avr/io.h" /* To use the UART Registers */
 #include "common_macros.h" /* To use the macros like SET_BIT */
 #include "twi.h"
 #include "dc_motor.h"
 #include "external_eeprom.h"
+#include "record_store.h"
+#include "audit_log.h"
 #include "buzzer.h"
+#include "sw_timer.h"
+#include "power.h"
+#include "profile.h"
 #include "timer.h"
+#include "supervisor.h"
+#include "crc.h"
+#include "util/atomic.h" /* For ATOMIC_BLOCK */
 #include "mc2.h"
 
 /*******************************************************************************
  *                      Global Variables                                       *
  *******************************************************************************/
 uint8 g_receivedPassword[PASS_SIZE];
-uint8 g_storedPassword[PASS_SIZE];
-uint8 g_wrongPasswordCounter=0;
-uint16 g_seconds = 0;
+uint8 g_storedPassword[PASS_SIZE]; /* RAM copy of the password in EEPROM, commands are checked against it */
+uint8 g_storedPasswordCrc; /* CRC-8 of g_storedPassword, to catch a corrupted RAM copy */
+RecordStore_Stamp g_storedPasswordStamp; /* stamp of the record g_storedPassword was loaded from */
+boolean g_storedPasswordValid = FALSE;
+volatile uint8 g_wrongPasswordCounter=0;
+volatile DoorPhase g_doorPhase = DOOR_CLOSED;
+DoorPhase g_lastMotion = DOOR_LOCKING; /* last phase the motor moved in */
+uint16 g_doorPosition = 0; /* door travel from closed in ms, DOOR_TRAVEL_MS when fully open */
+uint32 g_motionStart; /* time the motor started moving */
+boolean g_passwordExpected = FALSE; /* HMI is sending a new password */
+SwTimer g_secondTimer;
+SwTimer g_doorTimer;
+SwTimer g_alarmTimer;
 
 /*******************************************************************************
  *                          Function Definitions                               *
  *******************************************************************************/
 uint8 compare_passwords(uint8 a_password1[PASS_SIZE],uint8 a_password2[PASS_SIZE]) {
-	updateStoredPassword();
 	uint8 i;
 	for (i = 0; i < PASS_SIZE; i++) {
 		if (a_password1[i] != a_password2[i]) {
@@ -42,74 +60,353 @@ uint8 compare_passwords(uint8 a_password1[PASS_SIZE],uint8 a_password2[PASS_SIZE
 }
 
 void DoorOpeningTask(void){
-	/* run the DC motor clockwise for 15 seconds */
-	g_seconds = 0;
-	DcMotor_Rotate(Clockwise);
-	while (g_seconds < DOOR_UNLOCKING_PERIOD);
+	/* no EEPROM write cycle while the motor starts and pulls the supply down */
+	EEPROM_flush();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		doorUpdatePosition();
+		doorEnterPhase(DOOR_UNLOCKING);
+	}
+}
 
-	/* let the door be open for 3 seconds */
-	g_seconds = 0;
-	DcMotor_Rotate(Stop);
-	while (g_seconds < DOOR_LEFT_OPEN_PERIOD);
+void doorEnterPhase(DoorPhase phase){
+	uint16 period = 0;
 
-	/* hold the system for 15 seconds & display to user that door is locking */
-	g_seconds = 0;
-	DcMotor_Rotate(Anti_Clockwise);
-	while (g_seconds < DOOR_UNLOCKING_PERIOD);
+	/* a move that is already complete goes straight to the phase after it */
+	if (phase == DOOR_UNLOCKING && g_doorPosition >= DOOR_TRAVEL_MS){
+		phase = DOOR_OPEN;
+	}else if (phase == DOOR_LOCKING && g_doorPosition == 0){
+		phase = DOOR_CLOSED;
+	}
 
-	DcMotor_Rotate(Stop);
+	g_doorPhase = phase;
+	switch (phase){
+	case DOOR_UNLOCKING:
+		/* run the DC motor clockwise till the door is open */
+		DcMotor_Rotate(Clockwise);
+		period = DOOR_TRAVEL_MS - g_doorPosition;
+		break;
+	case DOOR_OPEN:
+		/* let the door be open for 3 seconds */
+		DcMotor_Rotate(Stop);
+		g_doorPosition = DOOR_TRAVEL_MS;
+		period = DOOR_LEFT_OPEN_PERIOD * 1000U;
+		break;
+	case DOOR_LOCKING:
+		/* rotate the DC motor anti-clockwise till the door is closed */
+		DcMotor_Rotate(Anti_Clockwise);
+		period = g_doorPosition;
+		break;
+	case DOOR_CLOSED:
+		g_doorPosition = 0;
+		DcMotor_Rotate(Stop);
+		break;
+	case DOOR_STOPPED:
+	default:
+		DcMotor_Rotate(Stop);
+		break;
+	}
+
+	if (phase == DOOR_UNLOCKING || phase == DOOR_LOCKING){
+		g_lastMotion = phase;
+		g_motionStart = Timer_getMillis();
+	}
+	if (period != 0){
+		SwTimer_start(&g_doorTimer, period, SW_TIMER_ONE_SHOT, doorPhaseCallBack);
+	}else{
+		SwTimer_cancel(&g_doorTimer);
+	}
+}
+
+void doorUpdatePosition(void){
+	uint32 elapsed;
+
+	if (g_doorPhase != DOOR_UNLOCKING && g_doorPhase != DOOR_LOCKING){
+		return;
+	}
+	elapsed = Timer_getMillis() - g_motionStart;
+	g_motionStart += elapsed;
+	if (g_doorPhase == DOOR_UNLOCKING){
+		g_doorPosition = (elapsed >= DOOR_TRAVEL_MS - g_doorPosition) ? DOOR_TRAVEL_MS : g_doorPosition + (uint16)elapsed;
+	}else{
+		g_doorPosition = (elapsed >= g_doorPosition) ? 0 : g_doorPosition - (uint16)elapsed;
+	}
+}
+
+void doorPhaseCallBack(void){
+	switch (g_doorPhase){
+	case DOOR_UNLOCKING:
+		g_doorPosition = DOOR_TRAVEL_MS;
+		doorEnterPhase(DOOR_OPEN);
+		break;
+	case DOOR_OPEN:
+		doorEnterPhase(DOOR_LOCKING);
+		break;
+	case DOOR_LOCKING:
+	default:
+		doorEnterPhase(DOOR_CLOSED);
+		break;
+	}
+}
+
+void doorStop(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if (g_doorPhase != DOOR_CLOSED){
+			doorUpdatePosition();
+			doorEnterPhase(DOOR_STOPPED);
+		}
+	}
+}
+
+void doorReverse(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		doorUpdatePosition();
+		switch (g_doorPhase){
+		case DOOR_UNLOCKING:
+		case DOOR_OPEN:
+			doorEnterPhase(DOOR_LOCKING);
+			break;
+		case DOOR_LOCKING:
+			doorEnterPhase(DOOR_UNLOCKING);
+			break;
+		case DOOR_STOPPED:
+			doorEnterPhase((g_lastMotion == DOOR_UNLOCKING) ? DOOR_LOCKING : DOOR_UNLOCKING);
+			break;
+		case DOOR_CLOSED:
+		default:
+			break;
+		}
+	}
+}
+
+void sendDoorState(void){
+	uint8 state[2];
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		doorUpdatePosition();
+		state[0] = g_doorPhase;
+		state[1] = (uint8)(((uint32)g_doorPosition * 100U) / DOOR_TRAVEL_MS);
+	}
+	PROTOCOL_sendFrame(MSG_DOOR_STATE, state, 2);
 }
 
 void timerCallBack(void){
-	g_seconds++;
+	UART_updateThroughput();
+}
+
+void alarmCallBack(void){
+	Buzzer_Deinit();
+	g_wrongPasswordCounter=0; /* reset the counter */
 }
 
 void initializePassword(void){
-	/* do not return from this function till Control ECU sends a PASSWORD_MATCH signal */
-	uint8 confirmationPassword[PASS_SIZE];
-	uint8 check=0;
-	while(!check){
-		while (UART_recieveByte() != READY_TO_SEND); /* wait till HMI gets ready */
-		UART_sendByte(READY_TO_RECEIVE); /* inform HMI that Control ECU ready to receive the password */
-		receivePasswordViaUART(g_receivedPassword);
-
-		while (UART_recieveByte() != READY_TO_SEND);
-		UART_sendByte(READY_TO_RECEIVE); /* inform HMI to send the confirmation password */
-		receivePasswordViaUART(confirmationPassword);
-
-		if (compare_passwords(g_receivedPassword, confirmationPassword) == PASSWORD_MATCHED){
-			UART_sendByte(READY_TO_SEND);
-			UART_sendByte(PASSWORD_MATCHED);
-			storePassword();
-			check=1;
-		}else{
-			UART_sendByte(READY_TO_SEND);
-			UART_sendByte(PASSWORD_MISMATCHED);
+	/* a reset of this ECU alone keeps the password, only a blank store waits for HMI to set one */
+	g_passwordExpected = !RecordStore_contains(RECORD_KEY_PASSWORD);
+}
+
+void safeStateCallBack(void){
+	/* the door stops where it is, a stalled cycle must not leave the motor running through the reset */
+	DcMotor_Rotate(Stop);
+}
+
+void sendSupervisorRecord(void){
+	Supervisor_Record record;
+	uint8 payload[6 + 2 * SUPERVISOR_MAX_TASKS];
+	uint8 i;
+
+	Supervisor_getRecord(&record);
+	payload[0] = record.resetCause;
+	payload[1] = (uint8)record.resetCount;
+	payload[2] = (uint8)(record.resetCount >> 8);
+	payload[3] = (uint8)record.watchdogTimeouts;
+	payload[4] = (uint8)(record.watchdogTimeouts >> 8);
+	payload[5] = record.lastMissedTask;
+	for (i = 0; i < SUPERVISOR_MAX_TASKS; i++){
+		payload[6 + 2 * i] = (uint8)record.missCounts[i];
+		payload[7 + 2 * i] = (uint8)(record.missCounts[i] >> 8);
+	}
+	PROTOCOL_sendFrame(MSG_SUPERVISOR_DATA, payload, sizeof(payload));
+}
+
+void handleFrame(const PROTOCOL_Frame * frame){
+	switch (frame->type){
+	case MSG_SET_PASSWORD:
+		if (frame->length == 2 * PASS_SIZE){
+			if (g_passwordExpected){
+				handleSetPassword(frame);
+			}else{
+				/* a change this ECU forgot in a reset, the stored password stays */
+				sendReplyViaUART(PASSWORD_SET);
+			}
+		}
+		break;
+	case MSG_COMMAND:
+		if (frame->length == PASS_SIZE + 1){
+			if (RecordStore_contains(RECORD_KEY_PASSWORD)){
+				g_passwordExpected = FALSE; /* HMI left a password change, it is asked for again */
+				handleCommand(frame);
+			}else{
+				sendReplyViaUART(PASSWORD_NOT_SET);
+			}
+		}
+		break;
+	case MSG_PASSWORD_STATUS:
+		/* HMI asks after its own reset, a change it was in the middle of is over */
+		initializePassword();
+		sendReplyViaUART(g_passwordExpected ? PASSWORD_NOT_SET : PASSWORD_SET);
+		break;
+	case MSG_DOOR_STATUS:
+		sendDoorState();
+		break;
+	case MSG_DOOR_STOP:
+		doorStop();
+		sendDoorState();
+		break;
+	case MSG_DOOR_REVERSE:
+		doorReverse();
+		sendDoorState();
+		break;
+	case MSG_SUPERVISOR_STATUS:
+		sendSupervisorRecord();
+		break;
+	case MSG_AUDIT_EXPORT:
+		if (frame->length == 1){
+			AuditLog_export(frame->payload[0], MSG_AUDIT_DATA);
 		}
+		break;
+#if (PROFILE_ENABLED == 1)
+	case MSG_PROFILE_DUMP:
+		Profile_dump(MSG_PROFILE_DATA);
+		break;
+#endif
+	default:
+		break;
 	}
 }
 
-void receivePasswordViaUART(uint8 * passwordArray){
-	uint8 cnt;
-	for (cnt=0;cnt<PASS_SIZE;cnt++){
-		*(passwordArray+cnt) = UART_recieveByte();
-		_delay_ms(100);
+void handleSetPassword(const PROTOCOL_Frame * frame){
+	uint8 i;
+	for (i=0;i<PASS_SIZE;i++){
+		g_receivedPassword[i] = frame->payload[i];
+	}
+
+	if (compare_passwords(g_receivedPassword, (uint8 *)frame->payload + PASS_SIZE) == PASSWORD_MATCHED){
+		/* HMI is only told the password is set once the EEPROM keeps it */
+		if (storePassword() == SUCCESS){
+			g_passwordExpected = FALSE;
+			sendReplyViaUART(PASSWORD_MATCHED);
+			AuditLog_append(AUDIT_EVENT_SET_PASSWORD, AUDIT_RESULT_SUCCESS);
+		}else{
+			sendReplyViaUART(PASSWORD_NOT_SAVED);
+			AuditLog_append(AUDIT_EVENT_SET_PASSWORD, AUDIT_RESULT_FAILURE);
+		}
+	}else{
+		sendReplyViaUART(PASSWORD_MISMATCHED);
+		AuditLog_append(AUDIT_EVENT_SET_PASSWORD, AUDIT_RESULT_FAILURE);
 	}
 }
 
-void updateStoredPassword(void){
+void handleCommand(const PROTOCOL_Frame * frame){
+	uint8 receivedByte = frame->payload[0];
+	uint8 passwordCheck = PASSWORD_MISMATCHED;
 	uint8 i;
 	for (i=0;i<PASS_SIZE;i++){
-		EEPROM_readByte(EEPROM_STORE_ADDREESS+i, g_storedPassword+i);
+		g_receivedPassword[i] = frame->payload[i + 1];
 	}
+
+	/* a RAM compare, with no trusted password stored every password is wrong */
+	if (validateStoredPassword()){
+		passwordCheck = compare_passwords(g_storedPassword, g_receivedPassword);
+	}
+
+	if ( receivedByte == '+'){
+		if (passwordCheck == PASSWORD_MATCHED){
+			sendReplyViaUART(UNLOCKING_DOOR); /* inform HMI ECU to display that door is unlocking */
+			DoorOpeningTask(); /* start opening door process/task, it runs on the door timer */
+			AuditLog_append(AUDIT_EVENT_UNLOCK, AUDIT_RESULT_SUCCESS);
+		}else{
+			sendReplyViaUART(WRONG_PASSWORD);
+			AuditLog_append(AUDIT_EVENT_UNLOCK, AUDIT_RESULT_FAILURE);
+			/* count number of wrong attempts, and turn on a buzzer of it exceeds the limit */
+			g_wrongPasswordCounter++;
+			if (g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS)
+			{
+				/* turn on alarm for a certain period, the alarm timer turns it off */
+				Buzzer_Start();
+				SwTimer_start(&g_alarmTimer, ALARM_ON_DELAY * 1000U, SW_TIMER_ONE_SHOT, alarmCallBack);
+				AuditLog_append(AUDIT_EVENT_ALARM, AUDIT_RESULT_SUCCESS);
+			}
+		}
+
+
+	} else if (receivedByte == CHANGE_PASSWORD_OPTION) {
+		if (passwordCheck == PASSWORD_MATCHED) {
+			sendReplyViaUART(CHANGING_PASSWORD); /* inform HMI to process changing password */
+			g_passwordExpected = TRUE; /* the new password comes in the next frames */
+			AuditLog_append(AUDIT_EVENT_CHANGE_PASSWORD, AUDIT_RESULT_SUCCESS);
+		}else{
+			sendReplyViaUART(WRONG_PASSWORD);
+			AuditLog_append(AUDIT_EVENT_CHANGE_PASSWORD, AUDIT_RESULT_FAILURE);
+			if (g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS)
+			{
+				/* turn on alarm for a certain period, the alarm timer turns it off */
+				Buzzer_Start();
+				SwTimer_start(&g_alarmTimer, ALARM_ON_DELAY * 1000U, SW_TIMER_ONE_SHOT, alarmCallBack);
+				AuditLog_append(AUDIT_EVENT_ALARM, AUDIT_RESULT_SUCCESS);
+			}
+		}
+	}
+}
+
+void sendReplyViaUART(uint8 response){
+	PROTOCOL_sendFrame(MSG_REPLY, &response, 1);
 }
 
-void storePassword(void){
+void updateStoredPassword(void){
+	uint8 record[RECORD_STORE_PAYLOAD_SIZE];
+	uint8 length = 0;
 	uint8 i;
-	for (i = 0; i < PASS_SIZE; i++) {
-		EEPROM_writeByte(EEPROM_STORE_ADDREESS + i, g_receivedPassword[i]);
-		_delay_ms(100);
+	uint8 status;
+
+	/* the record store checks the CRC of the record, a blank EEPROM has no password record */
+	PROFILE_BEGIN(PROFILE_RECORD_STORE_READ);
+	status = RecordStore_read(RECORD_KEY_PASSWORD, record, &length);
+	PROFILE_END(PROFILE_RECORD_STORE_READ);
+
+	for (i = 0; i < PASS_SIZE; i++){
+		g_storedPassword[i] = record[i];
+	}
+	g_storedPasswordCrc = CRC8_compute(g_storedPassword, PASS_SIZE);
+	g_storedPasswordValid = (status == SUCCESS) && (length == PASS_SIZE) &&
+			(RecordStore_readStamp(RECORD_KEY_PASSWORD, &g_storedPasswordStamp) == SUCCESS);
+}
+
+boolean validateStoredPassword(void){
+	RecordStore_Stamp stamp;
+
+	/* 3 bytes read from the EEPROM tell the record is still the one the RAM copy was loaded from */
+	if (!g_storedPasswordValid || CRC8_compute(g_storedPassword, PASS_SIZE) != g_storedPasswordCrc ||
+			RecordStore_readStamp(RECORD_KEY_PASSWORD, &stamp) == ERROR ||
+			stamp.seq != g_storedPasswordStamp.seq || stamp.crc != g_storedPasswordStamp.crc){
+		updateStoredPassword();
+	}
+	return g_storedPasswordValid;
+}
+
+uint8 storePassword(void){
+	uint8 status;
+
+	/* the record is written first, the RAM copy only ever holds a password the EEPROM keeps */
+	PROFILE_BEGIN(PROFILE_RECORD_STORE_WRITE);
+	status = RecordStore_write(RECORD_KEY_PASSWORD, g_receivedPassword, PASS_SIZE);
+	PROFILE_END(PROFILE_RECORD_STORE_WRITE);
+
+	/* read back: a record that does not hold the new password is a failed write as well */
+	updateStoredPassword();
+	if (status == ERROR || !g_storedPasswordValid ||
+			compare_passwords(g_storedPassword, g_receivedPassword) != PASSWORD_MATCHED){
+		return ERROR;
 	}
+	return SUCCESS;
 }
 
 int main(void)
@@ -119,11 +416,9 @@ int main(void)
 	UART_configType UART_Config = {DISABLED, ONE_BIT, BIT_8};
 	UART_init(UART_BAUD_RATE,&UART_Config);
 
-	/* Timer freq = 8MHz/1024, one clock-cycle time = 128 uSecond
-		so to force the timer to produce an interrupt every 1 second:
-		we set the compare value to be 1/(128u) = 7813 */
-	Timer_Config TIMER_Config = {Timer1, CTC,0, 7813, Prescale_1024, timerCallBack};
-	Timer_init(&TIMER_Config);
+	/* Timer1 drives the software timers, one of them calls timerCallBack every 1 second */
+	SwTimer_init();
+	SwTimer_start(&g_secondTimer, 1000, SW_TIMER_PERIODIC, timerCallBack);
 
 	/* initialize I2C */
 	TWI_Configurations TWI_Config = {0x02, TWI_CONTROL_ECU_ADDRESS};
@@ -132,54 +427,31 @@ int main(void)
 	DcMotor_Init();
 	Buzzer_init();
 
+	/* the main loop has to come round at least every MAIN_LOOP_DEADLINE_MS or the MCU is reset */
+	Supervisor_init(safeStateCallBack);
+	uint8 mainLoopTask = Supervisor_addTask(MAIN_LOOP_DEADLINE_MS);
+
+	/* the password is read once here, after that commands are checked against the RAM copy */
+	RecordStore_init();
+	updateStoredPassword();
+	AuditLog_init();
+	AuditLog_append(AUDIT_EVENT_BOOT, AUDIT_RESULT_SUCCESS);
 	initializePassword();
 
-	uint8 receivedByte=0;
+	PROTOCOL_Frame frame;
 
 	while (1)
 	{
-		if (UART_recieveByte() == READY_TO_SEND){
-			receivePasswordViaUART(g_receivedPassword);
-			receivedByte = UART_recieveByte();
-
-			if ( receivedByte == '+'){
-				if (compare_passwords(g_storedPassword, g_receivedPassword) == PASSWORD_MATCHED){
-					UART_sendByte(UNLOCKING_DOOR); /* inform HMI ECU to display that door is unlocking */
-					DoorOpeningTask(); /* start opening door process/task */
-				}else{
-					UART_sendByte(WRONG_PASSWORD);
-					/* count number of wrong attempts, and turn on a buzzer of it exceeds the limit */
-					g_wrongPasswordCounter++;
-					if (g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS)
-					{
-						Buzzer_Start();
-						g_seconds=0;
-						while(g_seconds < ALARM_ON_DELAY); /* turn on alarm for a certain period */
-						Buzzer_Deinit();
-						g_wrongPasswordCounter=0; /* reset the counter */
-					}
-				}
-
-
-			} else if (receivedByte == CHANGE_PASSWORD_OPTION) {
-				if (compare_passwords(g_storedPassword, g_receivedPassword) == PASSWORD_MATCHED) {
-					UART_sendByte(CHANGING_PASSWORD); /* inform HMI to process changing password */
-					initializePassword();
-				}else{
-					UART_sendByte(WRONG_PASSWORD);
-					if (g_wrongPasswordCounter == NUMBER_OF_WRONG_PASSWORD_ATTEMPTS)
-					{
-						Buzzer_Start();
-						g_seconds=0;
-						while(g_seconds < ALARM_ON_DELAY); /* turn on alarm for a certain period */
-						Buzzer_Deinit();
-						g_wrongPasswordCounter=0; /* reset the counter */
-					}
-				}
-			}
+		Supervisor_checkIn(mainLoopTask);
+
+		/* frames are handled as they come, the door moves on its own timer meanwhile */
+		if (PROTOCOL_pollFrame(&frame)){
+			handleFrame(&frame);
+		}else{
+			/* the audit entries are written once the frames are answered, off the unlock path */
+			AuditLog_flush();
+			EEPROM_service();
+			Power_idle(); /* the second timer wakes the loop up at least once a second */
 		}
 	}
 }
-
-
-
@@ -14,6 +14,7 @@
 #define MC2_H_
 
 #include "std_types.h"
+#include "protocol.h"
 
 /*******************************************************************************
  *                                Definitions                                  *
@@ -26,15 +27,59 @@
 /* following definitions used to communicate with HMI ECU */
 #define PASSWORD_MATCHED		(1)
 #define PASSWORD_MISMATCHED		(0)
-#define READY_TO_SEND			(0x15)
-#define READY_TO_RECEIVE		(0x16)
 #define CHANGE_PASSWORD_OPTION	(0x18)
 #define UNLOCKING_DOOR			(0x25)
 #define WRONG_PASSWORD			(0x30)
 #define CHANGING_PASSWORD		(0X31)
+#define PASSWORD_NOT_SET		(0x32)  /* no password stored, HMI has to set one first */
+#define PASSWORD_SET			(0x33)  /* a password is stored, no new one is expected */
+#define PASSWORD_NOT_SAVED		(0x34)  /* the passwords match but the EEPROM write failed, nothing changed */
+/* message types of the frames exchanged with HMI ECU */
+#define MSG_SET_PASSWORD		(0x01)  /* payload: password + confirmation */
+#define MSG_COMMAND				(0x02)  /* payload: option + password */
+#define MSG_REPLY				(0x03)  /* payload: one response code */
+#define MSG_PROFILE_DUMP		(0x04)  /* no payload, asks for the probes table */
+#define MSG_PROFILE_DATA		(0x05)  /* payload: one record of the probes table */
+#define MSG_DOOR_STATUS			(0x06)  /* no payload, asks for the door state */
+#define MSG_DOOR_STATE			(0x07)  /* payload: door phase + percentage open */
+#define MSG_DOOR_STOP			(0x08)  /* no payload, emergency stop, answered with MSG_DOOR_STATE */
+#define MSG_DOOR_REVERSE		(0x09)  /* no payload, reverse the door motion, answered with MSG_DOOR_STATE */
+#define MSG_SUPERVISOR_STATUS	(0x0A)  /* no payload, asks for the reset record */
+#define MSG_SUPERVISOR_DATA		(0x0B)  /* payload: reset cause, reset count16, watchdog timeouts16,
+										   last missed task, miss count16 per task (LSB first) */
+#define MSG_AUDIT_EXPORT		(0x0C)  /* payload: number of entries, asks for the newest audit entries */
+#define MSG_AUDIT_DATA			(0x0D)  /* payload: whole audit entries oldest first (audit_log.h),
+										   an empty frame ends the export. Entry times are ms
+										   since the boot that logged them, not across boots */
+#define MSG_PASSWORD_STATUS		(0x0E)  /* no payload, answered with PASSWORD_SET or PASSWORD_NOT_SET */
 
 #define TWI_CONTROL_ECU_ADDRESS				(0x1)
-#define EEPROM_STORE_ADDREESS				(0x00)
+
+/* keys of the records kept in the EEPROM record store */
+#define RECORD_KEY_PASSWORD					(0)
+
+/* events and results of the audit log entries */
+#define AUDIT_EVENT_BOOT					(0)
+#define AUDIT_EVENT_UNLOCK					(1)
+#define AUDIT_EVENT_CHANGE_PASSWORD			(2)
+#define AUDIT_EVENT_SET_PASSWORD			(3)
+#define AUDIT_EVENT_ALARM					(4)  /* too many wrong passwords, the result is always SUCCESS */
+#define AUDIT_RESULT_SUCCESS				(0)
+#define AUDIT_RESULT_FAILURE				(1)
+
+/* longest time the main loop may take to come round, with a wide margin over an EEPROM write */
+#define MAIN_LOOP_DEADLINE_MS				(2000)
+
+/* time the motor takes to move the door from closed to fully open (and back) */
+#define DOOR_TRAVEL_MS						(DOOR_UNLOCKING_PERIOD * 1000U)
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+typedef enum
+{
+	DOOR_CLOSED,DOOR_UNLOCKING,DOOR_OPEN,DOOR_LOCKING,DOOR_STOPPED
+}DoorPhase;
 
 /*******************************************************************************
  *                      Functions Prototypes                                   *
@@ -45,35 +90,107 @@
 uint8 compare_passwords(uint8 a_password1[PASS_SIZE],uint8 a_password2[PASS_SIZE]);
 
 /*
- * Description: a function to initialize the password in first-run OR to change the password
+ * Description: a function to wait for the password in first-run, when the EEPROM keeps none: commands are
+ * 		answered with PASSWORD_NOT_SET till HMI sent two matching passwords
  * */
 void initializePassword(void);
 
 /*
- * Decription: A function that rotates on the DC motor for 15 seconds clockwise, stops it for 3 seconds, then
- * 		rotates it anti-clockwise for 15 seconds.
+ * Description: the function called by the supervisor before it resets the MCU, stops the door motor
+ * */
+void safeStateCallBack(void);
+
+/*
+ * Description: A function that sends the reset record of the supervisor to HMI ECU
+ * */
+void sendSupervisorRecord(void);
+
+/*
+ * Description: A function that handles a frame received from HMI ECU, it never waits for the door
+ * */
+void handleFrame(const PROTOCOL_Frame * frame);
+
+/*
+ * Description: A function that handles a password and its confirmation sent by HMI ECU
+ * */
+void handleSetPassword(const PROTOCOL_Frame * frame);
+
+/*
+ * Description: A function that handles a menu option sent by HMI ECU along with the password
+ * */
+void handleCommand(const PROTOCOL_Frame * frame);
+
+/*
+ * Decription: A function that starts opening the door from wherever it is: the DC motor rotates clockwise
+ * 		till the door is open, stops for 3 seconds, then rotates anti-clockwise till the door is closed.
+ * 		It returns at once, the door timer moves the door through the phases.
  * */
 void DoorOpeningTask(void);
 
+/*
+ * Decription: A function that moves the door to a phase, starting the motor and the door timer as needed
+ * */
+void doorEnterPhase(DoorPhase phase);
+
+/*
+ * Decription: A function that accounts the door travel since the motor started moving
+ * */
+void doorUpdatePosition(void);
+
+/*
+ * Decription: A function that stops the door where it is (emergency stop)
+ * */
+void doorStop(void);
+
+/*
+ * Decription: A function that reverses the door: an opening door closes, a closing door opens again
+ * 		(an obstacle in the way), a stopped door moves back the way it came and an open door closes at once
+ * */
+void doorReverse(void);
+
+/*
+ * Decription: A function that sends the door phase and how far it is open to HMI ECU
+ * */
+void sendDoorState(void);
+
 /*
  * Decription: the call-back function called by the timer every 1 second
  * */
 void timerCallBack(void);
 
 /*
- * Description: A function to receive the password via UART by looping on receiveByte function
+ * Decription: the call-back function of the door timer, moves the door to its next phase
+ * */
+void doorPhaseCallBack(void);
+
+/*
+ * Decription: the call-back function of the alarm timer, stops the buzzer when the alarm period ends
  * */
-void receivePasswordViaUART(uint8 * passwordArray);
+void alarmCallBack(void);
 
 /*
- * Description: A function to retreive the stored password from EEPROM
+ * Description: A function to send a one-byte response code to HMI ECU in a reply frame
+ * */
+void sendReplyViaUART(uint8 response);
+
+/*
+ * Description: A function to load the stored password record from EEPROM into its RAM copy,
+ * the copy is marked invalid if there is no valid record
  * */
 void updateStoredPassword(void);
 
 /*
- * Description: A function to store the password in EEPROM
+ * Description: A function to check the RAM copy of the stored password against its CRC and against
+ * the stamp of the record in EEPROM, reloading it if it was corrupted or the record is not the one
+ * it was loaded from. Returns TRUE if the copy can be trusted
+ * */
+boolean validateStoredPassword(void);
+
+/*
+ * Description: A function to store the received password in the EEPROM record store, then load it
+ * back into the RAM copy. Returns ERROR if it could not be written, the old password stays then
  * */
-void storePassword(void);
+uint8 storePassword(void);
 
 
 #endif /* MC2_H_ */
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ *  [FILE NAME]: power.c
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 17, 2026
+ *
+ *  [DESCRIPTION]: Source file for the tickless idle power management
+ *******************************************************************************/
+
+#include "power.h"
+#include "sw_timer.h"
+#include "timer.h"
+#include "avr/io.h"
+#include "avr/interrupt.h"
+#include "avr/sleep.h"
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* Set by interrupts, cleared each time the application goes through Power_idle */
+static volatile boolean g_eventPending = FALSE;
+
+/*******************************************************************************
+ *                         Function Definitions                                *
+ *******************************************************************************/
+void Power_idle(void)
+{
+	uint32 ticks;
+
+	cli();
+	/* an event signalled after the caller checked its condition must not be slept through */
+	if (!g_eventPending)
+	{
+		ticks = SwTimer_ticksToNextExpiry();
+		Timer_stretchClock((ticks > TIMER_CLOCK_MAX_STRETCH_MS) ? TIMER_CLOCK_MAX_STRETCH_MS : (uint8)ticks);
+
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_enable();
+		/* the instruction after sei is always executed before a pending interrupt */
+		sei();
+		sleep_cpu();
+		sleep_disable();
+
+		/* woken up by something other than the clock: go back to the 1 ms tick */
+		Timer_restoreClock();
+		cli();
+	}
+	g_eventPending = FALSE;
+	sei();
+}
+
+void Power_signalEvent(void)
+{
+	g_eventPending = TRUE;
+}
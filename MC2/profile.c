@@ -0,0 +1,148 @@
+ /******************************************************************************
+ *
+ * Module: PROFILE
+ *
+ * File Name: profile.c
+ *
+ * Description: Source file for the execution time probes
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#include "profile.h"
+
+#if (PROFILE_ENABLED == 1)
+
+#include "timer.h"
+#include "protocol.h"
+#include "util/atomic.h" /* For ATOMIC_BLOCK */
+
+/*******************************************************************************
+ *                           Private Definitions                               *
+ *******************************************************************************/
+#define PROFILE_CYCLES_PER_US           (F_CPU / 1000000UL)
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+static ProfileStats g_probes[PROFILE_NUMBER_OF_PROBES];
+
+/*******************************************************************************
+ *                      Private Functions Prototypes                           *
+ *******************************************************************************/
+static uint8 *Profile_put(uint8 *dst, uint32 value, uint8 size);
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+uint32 Profile_now(void)
+{
+	return Timer_getMicros() * PROFILE_CYCLES_PER_US;
+}
+
+void Profile_record(ProfileProbe probe, uint32 startCycles)
+{
+	uint32 cycles = Profile_now() - startCycles;
+	ProfileStats *stats = &g_probes[probe];
+	uint32 limit = PROFILE_FIRST_BIN_LIMIT;
+	uint8 bin = 0;
+
+	while((bin < PROFILE_HISTOGRAM_BINS - 1) && (cycles >= limit))
+	{
+		bin++;
+		limit <<= 2;
+	}
+
+	/* probes may be hit from interrupts as well */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if((stats->count != 0xFFFF) && (stats->sumCycles + cycles >= stats->sumCycles))
+		{
+			if((stats->count == 0) || (cycles < stats->minCycles))
+			{
+				stats->minCycles = cycles;
+			}
+			if(cycles > stats->maxCycles)
+			{
+				stats->maxCycles = cycles;
+			}
+			stats->sumCycles += cycles;
+			stats->count++;
+			stats->histogram[bin]++;
+		}
+	}
+}
+
+void Profile_getStats(ProfileProbe probe, ProfileStats *stats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*stats = g_probes[probe];
+	}
+}
+
+void Profile_reset(void)
+{
+	uint8 probe, bin;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for(probe = 0; probe < PROFILE_NUMBER_OF_PROBES; probe++)
+		{
+			g_probes[probe].count = 0;
+			g_probes[probe].minCycles = 0;
+			g_probes[probe].maxCycles = 0;
+			g_probes[probe].sumCycles = 0;
+			for(bin = 0; bin < PROFILE_HISTOGRAM_BINS; bin++)
+			{
+				g_probes[probe].histogram[bin] = 0;
+			}
+		}
+	}
+}
+
+void Profile_dump(uint8 frameType)
+{
+	ProfileStats stats;
+	uint8 payload[PROTOCOL_MAX_PAYLOAD];
+	uint8 *dst;
+	uint8 probe, bin;
+
+	for(probe = 0; probe < PROFILE_NUMBER_OF_PROBES; probe++)
+	{
+		Profile_getStats(probe, &stats);
+
+		payload[0] = probe;
+		payload[1] = PROFILE_RECORD_STATS;
+		dst = Profile_put(payload + 2, stats.count, 2);
+		dst = Profile_put(dst, stats.minCycles, 4);
+		dst = Profile_put(dst, stats.maxCycles, 4);
+		dst = Profile_put(dst, (stats.count != 0) ? (stats.sumCycles / stats.count) : 0, 4);
+		PROTOCOL_sendFrame(frameType, payload, dst - payload);
+
+		payload[1] = PROFILE_RECORD_HISTOGRAM;
+		dst = payload + 2;
+		for(bin = 0; bin < PROFILE_HISTOGRAM_BINS; bin++)
+		{
+			dst = Profile_put(dst, stats.histogram[bin], 2);
+		}
+		PROTOCOL_sendFrame(frameType, payload, dst - payload);
+	}
+}
+
+/*
+ * Description: Stores the size low bytes of value at dst, least significant first,
+ * 	and returns the position after them.
+ * */
+static uint8 *Profile_put(uint8 *dst, uint32 value, uint8 size)
+{
+	while(size--)
+	{
+		*dst++ = (uint8)value;
+		value >>= 8;
+	}
+	return dst;
+}
+
+#endif /* PROFILE_ENABLED */
@@ -0,0 +1,106 @@
+ /******************************************************************************
+ *
+ * Module: PROFILE
+ *
+ * File Name: profile.h
+ *
+ * Description: Header file for the execution time probes
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include "std_types.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+/*
+ * Set to 1 to build the probes in. With 0 the PROFILE_ macros expand to nothing and this module
+ * compiles to nothing, so the firmware is the same as without the probes.
+ */
+#define PROFILE_ENABLED                 0
+
+/*
+ * Histogram bins are powers of 4 of the duration in cycles: bin 0 counts durations below 32 cycles
+ * (4 us), bin n those below 32 * 4^n cycles, the last bin everything longer (above 2 ms).
+ * 7 bins of 16 bits fill a frame payload together with the probe id and record kind.
+ */
+#define PROFILE_HISTOGRAM_BINS          7
+#define PROFILE_FIRST_BIN_LIMIT         32
+
+/* Second byte of the dumped frames */
+#define PROFILE_RECORD_STATS            0   /* id, kind, count16, min32, max32, mean32 (cycles) */
+#define PROFILE_RECORD_HISTOGRAM        1   /* id, kind, PROFILE_HISTOGRAM_BINS x count16 */
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+/* Probe ids of both ECUs, a probe which is never hit is dumped with a zero count */
+typedef enum
+{
+	PROFILE_LCD_SEND_COMMAND, PROFILE_KEYPAD_SCAN, PROFILE_RECORD_STORE_WRITE, PROFILE_RECORD_STORE_READ,
+	PROFILE_PROTOCOL_SEND_FRAME, PROFILE_NUMBER_OF_PROBES
+}ProfileProbe;
+
+typedef struct
+{
+	uint16 count;       /* saturates at 0xFFFF, the other figures stop updating then */
+	uint32 minCycles;
+	uint32 maxCycles;
+	uint32 sumCycles;
+	uint16 histogram[PROFILE_HISTOGRAM_BINS];
+}ProfileStats;
+
+/*******************************************************************************
+ *                                Macros                                       *
+ *******************************************************************************/
+#if (PROFILE_ENABLED == 1)
+/*
+ * PROFILE_BEGIN and PROFILE_END enclose the measured code, in the same block and on a path
+ * without an early return. The time base is the Timer1 monotonic clock (8 cycles resolution
+ * at 8 MHz), so Timer_startClock must have been called.
+ */
+#define PROFILE_BEGIN(ID)       uint32 profileStart_##ID = Profile_now()
+#define PROFILE_END(ID)         Profile_record((ID), profileStart_##ID)
+#else
+#define PROFILE_BEGIN(ID)
+#define PROFILE_END(ID)
+#endif
+
+#if (PROFILE_ENABLED == 1)
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+/*
+ * Description: A function that returns the current time stamp in CPU cycles.
+ * */
+uint32 Profile_now(void);
+
+/*
+ * Description: A function that adds the duration since startCycles to the probe statistics.
+ * */
+void Profile_record(ProfileProbe probe, uint32 startCycles);
+
+/*
+ * Description: A function that copies the statistics of a probe.
+ * */
+void Profile_getStats(ProfileProbe probe, ProfileStats *stats);
+
+/*
+ * Description: A function that clears the statistics of all probes.
+ * */
+void Profile_reset(void);
+
+/*
+ * Description: A function that sends the table of all probes over UART, two frames of the
+ * 	given type per probe (PROFILE_RECORD_STATS then PROFILE_RECORD_HISTOGRAM), multi-byte
+ * 	values least significant byte first.
+ * */
+void Profile_dump(uint8 frameType);
+#endif
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,252 @@
+ /******************************************************************************
+ *
+ * Module: PROTOCOL
+ *
+ * File Name: protocol.c
+ *
+ * Description: Source file for the framed message protocol between the two ECUs
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#include "protocol.h"
+#include "crc.h"
+#include "uart.h"
+#include "sw_timer.h" /* For the receive timeout */
+#include "power.h" /* To sleep while waiting */
+#include "profile.h"
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+typedef enum
+{
+	WAIT_START,WAIT_TYPE,WAIT_LENGTH,WAIT_PAYLOAD,WAIT_CRC
+}PROTOCOL_parserState;
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* Receive side parser context, a frame is assembled in place byte by byte */
+static PROTOCOL_parserState g_parserState = WAIT_START;
+static PROTOCOL_Frame g_rxFrame;
+static uint8 g_rxIndex = 0;
+static uint8 g_rxCrc = CRC8_INITIAL_VALUE;
+
+/* Deadline of the current receive with timeout, known to the timer wheel so idle sleep respects it */
+static SwTimer g_timeoutTimer;
+
+/*******************************************************************************
+ *                      Functions Prototypes(Private)                          *
+ *******************************************************************************/
+/*
+ * Description :
+ * Feed one received byte to the frame parser.
+ * Return TRUE when it completes a frame with a valid CRC, the frame is then in g_rxFrame.
+ */
+static boolean PROTOCOL_parseByte(uint8 data);
+
+/*
+ * Description :
+ * Answer a link control request sent by the other ECU.
+ * Return FALSE if the frame is not a request, it is then left to the application.
+ */
+static boolean PROTOCOL_handleLinkFrame(const PROTOCOL_Frame *frame);
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Build a frame around the given payload and queue it on the UART.
+ */
+void PROTOCOL_sendFrame(uint8 type, const uint8 *payload, uint8 length)
+{
+	uint8 buffer[PROTOCOL_MAX_PAYLOAD + PROTOCOL_FRAME_OVERHEAD];
+	uint8 crc = CRC8_INITIAL_VALUE;
+	uint8 i;
+
+	if(length > PROTOCOL_MAX_PAYLOAD)
+	{
+		return;
+	}
+	PROFILE_BEGIN(PROFILE_PROTOCOL_SEND_FRAME);
+
+	buffer[0] = PROTOCOL_START_BYTE;
+	buffer[1] = type;
+	buffer[2] = length;
+	crc = CRC8_update(crc, type);
+	crc = CRC8_update(crc, length);
+	for(i = 0; i < length; i++)
+	{
+		buffer[3 + i] = payload[i];
+		crc = CRC8_update(crc, payload[i]);
+	}
+	buffer[3 + length] = crc;
+
+	/* The whole frame is queued at once, wait only if the TX queue is still full */
+	while(!UART_sendBuffer(buffer, length + PROTOCOL_FRAME_OVERHEAD)){}
+	PROFILE_END(PROFILE_PROTOCOL_SEND_FRAME);
+}
+
+/*
+ * Description :
+ * Feed all received UART bytes to the frame parser without blocking.
+ * Return TRUE and fill frame once a complete frame with a valid CRC has been received,
+ * link control requests of the other ECU are answered here and never returned.
+ */
+boolean PROTOCOL_pollFrame(PROTOCOL_Frame *frame)
+{
+	uint8 data;
+
+	/* The other ECU gave up on the negotiated rate, follow it back to the safe one */
+	if(UART_breakDetected())
+	{
+		UART_setBaudIndex(UART_SAFE_BAUD_INDEX);
+		g_parserState = WAIT_START;
+	}
+
+	while(UART_tryReceiveByte(&data))
+	{
+		if(PROTOCOL_parseByte(data))
+		{
+			if((g_rxFrame.type >= PROTOCOL_LINK_MSG_BASE) && PROTOCOL_handleLinkFrame(&g_rxFrame))
+			{
+				continue;
+			}
+			*frame = g_rxFrame;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/*
+ * Description :
+ * Wait until a complete frame with a valid CRC has been received.
+ */
+void PROTOCOL_receiveFrame(PROTOCOL_Frame *frame)
+{
+	while(!PROTOCOL_pollFrame(frame))
+	{
+		Power_idle();
+	}
+}
+
+/*
+ * Description :
+ * Wait up to timeout_ms for a complete frame with a valid CRC.
+ * Return FALSE if no frame has been received in time.
+ */
+boolean PROTOCOL_receiveFrameTimeout(PROTOCOL_Frame *frame, uint16 timeout_ms)
+{
+	SwTimer_start(&g_timeoutTimer, timeout_ms, SW_TIMER_ONE_SHOT, NULL_PTR);
+
+	while(!PROTOCOL_pollFrame(frame))
+	{
+		if(!SwTimer_isActive(&g_timeoutTimer))
+		{
+			return FALSE;
+		}
+		Power_idle();
+	}
+	SwTimer_cancel(&g_timeoutTimer);
+	return TRUE;
+}
+
+/*
+ * Description :
+ * Return to the safe baud rate and send a break so the other ECU does the same, without waiting.
+ * The transmitter must be idle (UART_isTxComplete), the frames sent meanwhile follow the break.
+ */
+void PROTOCOL_linkFallback(void)
+{
+	UART_setBaudIndex(UART_SAFE_BAUD_INDEX);
+	UART_sendBreak();
+	g_parserState = WAIT_START;
+}
+
+static boolean PROTOCOL_parseByte(uint8 data)
+{
+	switch(g_parserState)
+	{
+	case WAIT_START:
+		if(data == PROTOCOL_START_BYTE)
+		{
+			g_rxCrc = CRC8_INITIAL_VALUE;
+			g_parserState = WAIT_TYPE;
+		}
+		break;
+
+	case WAIT_TYPE:
+		g_rxFrame.type = data;
+		g_rxCrc = CRC8_update(g_rxCrc, data);
+		g_parserState = WAIT_LENGTH;
+		break;
+
+	case WAIT_LENGTH:
+		if(data > PROTOCOL_MAX_PAYLOAD)
+		{
+			/* Not a valid frame, look for the next start byte */
+			g_parserState = WAIT_START;
+			break;
+		}
+		g_rxFrame.length = data;
+		g_rxCrc = CRC8_update(g_rxCrc, data);
+		g_rxIndex = 0;
+		g_parserState = (data == 0) ? WAIT_CRC : WAIT_PAYLOAD;
+		break;
+
+	case WAIT_PAYLOAD:
+		g_rxFrame.payload[g_rxIndex++] = data;
+		g_rxCrc = CRC8_update(g_rxCrc, data);
+		if(g_rxIndex == g_rxFrame.length)
+		{
+			g_parserState = WAIT_CRC;
+		}
+		break;
+
+	case WAIT_CRC:
+		g_parserState = WAIT_START;
+		/* Corrupted frame is dropped */
+		return (data == g_rxCrc);
+	}
+	return FALSE;
+}
+
+static boolean PROTOCOL_handleLinkFrame(const PROTOCOL_Frame *frame)
+{
+	uint8 index;
+
+	switch(frame->type)
+	{
+	case PROTOCOL_MSG_BAUD_REQUEST:
+		if(frame->length != 1)
+		{
+			break;
+		}
+		index = frame->payload[0];
+		if(UART_isBaudUsable(index))
+		{
+			/* The accept goes out at the old rate, UART_setBaudIndex switches once it is sent */
+			PROTOCOL_sendFrame(PROTOCOL_MSG_BAUD_ACCEPT, &index, 1);
+			UART_setBaudIndex(index);
+		}
+		else
+		{
+			PROTOCOL_sendFrame(PROTOCOL_MSG_BAUD_REJECT, &index, 1);
+		}
+		break;
+
+	case PROTOCOL_MSG_LINK_CHECK:
+		PROTOCOL_sendFrame(PROTOCOL_MSG_LINK_CHECK_ACK, NULL_PTR, 0);
+		break;
+
+	default:
+		/* Answers to our own requests go to the application that sent them */
+		return FALSE;
+	}
+	return TRUE;
+}
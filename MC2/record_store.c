@@ -0,0 +1,351 @@
+/*******************************************************************************
+ *  [FILE NAME]: record_store.c
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 18, 2026
+ *
+ *  [DESCRIPTION]: Source file for the log-structured record store on the external EEPROM
+ *******************************************************************************/
+
+#include "record_store.h"
+#include "crc.h"
+
+/*******************************************************************************
+ *                           Private Definitions                               *
+ *******************************************************************************/
+/* Layout of a record page */
+#define RECORD_KEY          0
+#define RECORD_SEQ_LOW      1
+#define RECORD_SEQ_HIGH     2
+#define RECORD_LENGTH       3
+#define RECORD_PAYLOAD      4
+#define RECORD_CRC          (EEPROM_PAGE_SIZE - 1)
+
+/* Index entry of a missing record, and owner of a free page */
+#define RECORD_NO_PAGE      0xFF
+#define RECORD_NO_KEY       0xFF
+
+/* The two generations of a key */
+#define RECORD_CURRENT      0
+#define RECORD_PREVIOUS     1
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* RAM index: page and sequence number of the current and previous record of every key */
+static uint8 g_indexPage[RECORD_STORE_MAX_KEYS][2];
+static uint16 g_indexSeq[RECORD_STORE_MAX_KEYS][2];
+
+static uint8 g_head = 0;    /* next page the log writes */
+static uint16 g_seq = 0;    /* sequence number of the newest record */
+
+/*******************************************************************************
+ *                      Private Functions Prototypes                           *
+ *******************************************************************************/
+static uint16 RecordStore_pageAddress(uint8 page);
+static uint8 RecordStore_nextPage(uint8 page);
+static boolean RecordStore_isNewer(uint16 seq, uint16 than);
+static uint8 RecordStore_owner(uint8 page, uint8 *generation);
+static uint8 RecordStore_freePage(uint8 page, uint8 skip);
+static void RecordStore_addToIndex(uint8 key, uint8 page, uint16 seq);
+static boolean RecordStore_isValid(const uint8 *buffer);
+static uint8 RecordStore_readPage(uint8 page, uint8 *buffer);
+static uint8 RecordStore_writePage(uint8 page, uint8 key, const uint8 *data, uint8 length);
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+void RecordStore_init(void)
+{
+	uint8 buffer[EEPROM_PAGE_SIZE];
+	uint8 page;
+	uint8 key;
+	uint8 generation;
+	uint16 seq;
+	boolean empty = TRUE;
+
+	for(key = 0; key < RECORD_STORE_MAX_KEYS; key++)
+	{
+		g_indexPage[key][RECORD_CURRENT] = RECORD_NO_PAGE;
+		g_indexPage[key][RECORD_PREVIOUS] = RECORD_NO_PAGE;
+	}
+	g_head = 0;
+	g_seq = 0;
+
+	for(page = 0; page < RECORD_STORE_PAGES; page++)
+	{
+		if(EEPROM_readBuffer(RecordStore_pageAddress(page), buffer, EEPROM_PAGE_SIZE) == ERROR)
+		{
+			break; /* the EEPROM does not answer even after the retries, do not try every page */
+		}
+		if(!RecordStore_isValid(buffer))
+		{
+			continue;
+		}
+		seq = buffer[RECORD_SEQ_LOW] | ((uint16)buffer[RECORD_SEQ_HIGH] << 8);
+		RecordStore_addToIndex(buffer[RECORD_KEY], page, seq);
+
+		/* the log goes on after its newest record */
+		if(empty || RecordStore_isNewer(seq, g_seq))
+		{
+			g_seq = seq;
+			g_head = RecordStore_nextPage(page);
+			empty = FALSE;
+		}
+	}
+
+	/*
+	 * The compaction copies made for the newest record were written just before it, the last
+	 * one with the sequence number before it, on the first free pages after it. The record
+	 * with that sequence number is either such a copy, ahead of the newest record, or the
+	 * record written before it, behind: the log goes on after the last copy if there is one.
+	 */
+	page = (uint8)(g_head + RECORD_STORE_PAGES - 1) % RECORD_STORE_PAGES; /* the newest record */
+	for(key = 0; (key < RECORD_STORE_MAX_KEYS) && !empty; key++)
+	{
+		for(generation = RECORD_CURRENT; generation <= RECORD_PREVIOUS; generation++)
+		{
+			if((g_indexPage[key][generation] != RECORD_NO_PAGE) && (g_indexSeq[key][generation] == (uint16)(g_seq - 1)) &&
+					((uint8)(g_indexPage[key][generation] + RECORD_STORE_PAGES - page) % RECORD_STORE_PAGES < RECORD_STORE_PAGES / 2))
+			{
+				g_head = RecordStore_nextPage(g_indexPage[key][generation]);
+			}
+		}
+	}
+}
+
+uint8 RecordStore_write(uint8 key, const uint8 *data, uint8 length)
+{
+	uint8 buffer[EEPROM_PAGE_SIZE];
+	uint8 target = g_head;  /* page the new record goes to */
+	uint8 copy = RECORD_NO_PAGE; /* page the last compaction copy went to */
+	uint8 owner;
+	uint8 generation;
+
+	if((key >= RECORD_STORE_MAX_KEYS) || (length > RECORD_STORE_PAYLOAD_SIZE))
+	{
+		return ERROR;
+	}
+
+	for(;;)
+	{
+		owner = RecordStore_owner(target, &generation);
+		if((owner == RECORD_NO_KEY) || ((owner == key) && (generation == RECORD_PREVIOUS)))
+		{
+			break; /* free, or holding the generation this write replaces */
+		}
+		if(owner == key)
+		{
+			/* the current record of the key stays till the new one is written, go past it */
+			target = RecordStore_nextPage(target);
+			continue;
+		}
+
+		/*
+		 * Compaction: the page the log came round to holds a record another key still needs.
+		 * Copy that key's current record to the next free page, which makes the copy its
+		 * current record and its current record the previous one. A page that held the
+		 * previous record is free after one copy, one that held the current record after two.
+		 */
+		copy = RecordStore_freePage((copy == RECORD_NO_PAGE) ? RecordStore_nextPage(target) : RecordStore_nextPage(copy), target);
+		if((RecordStore_readPage(g_indexPage[owner][RECORD_CURRENT], buffer) == ERROR) ||
+				(RecordStore_writePage(copy, owner, buffer + RECORD_PAYLOAD, buffer[RECORD_LENGTH]) == ERROR))
+		{
+			return ERROR;
+		}
+	}
+
+	if(RecordStore_writePage(target, key, data, length) == ERROR)
+	{
+		return ERROR;
+	}
+	/* the log goes on after the new record, or after the copies made for it */
+	g_head = RecordStore_nextPage((copy == RECORD_NO_PAGE) ? target : copy);
+	return SUCCESS;
+}
+
+uint8 RecordStore_read(uint8 key, uint8 *data, uint8 *length)
+{
+	uint8 buffer[EEPROM_PAGE_SIZE];
+	uint8 generation;
+	uint8 i;
+
+	if(!RecordStore_contains(key))
+	{
+		return ERROR;
+	}
+	for(generation = RECORD_CURRENT; generation <= RECORD_PREVIOUS; generation++)
+	{
+		if((g_indexPage[key][generation] != RECORD_NO_PAGE) &&
+				(RecordStore_readPage(g_indexPage[key][generation], buffer) == SUCCESS) &&
+				(buffer[RECORD_KEY] == key))
+		{
+			*length = buffer[RECORD_LENGTH];
+			for(i = 0; i < *length; i++)
+			{
+				data[i] = buffer[RECORD_PAYLOAD + i];
+			}
+			return SUCCESS;
+		}
+	}
+	return ERROR;
+}
+
+boolean RecordStore_contains(uint8 key)
+{
+	return (key < RECORD_STORE_MAX_KEYS) && (g_indexPage[key][RECORD_CURRENT] != RECORD_NO_PAGE);
+}
+
+uint8 RecordStore_readStamp(uint8 key, RecordStore_Stamp *stamp)
+{
+	uint8 seq[2];
+	uint16 address;
+
+	if(!RecordStore_contains(key))
+	{
+		return ERROR;
+	}
+	address = RecordStore_pageAddress(g_indexPage[key][RECORD_CURRENT]);
+	if((EEPROM_readBuffer(address + RECORD_SEQ_LOW, seq, 2) == ERROR) ||
+			(EEPROM_readBuffer(address + RECORD_CRC, &stamp->crc, 1) == ERROR))
+	{
+		return ERROR;
+	}
+	stamp->seq = seq[0] | ((uint16)seq[1] << 8);
+	return SUCCESS;
+}
+
+/*
+ * Description :
+ * EEPROM address of a log page.
+ */
+static uint16 RecordStore_pageAddress(uint8 page)
+{
+	return (uint16)(RECORD_STORE_FIRST_PAGE + page) * EEPROM_PAGE_SIZE;
+}
+
+static uint8 RecordStore_nextPage(uint8 page)
+{
+	page++;
+	return (page == RECORD_STORE_PAGES) ? 0 : page;
+}
+
+/*
+ * Description :
+ * Compare two sequence numbers that may have wrapped round.
+ */
+static boolean RecordStore_isNewer(uint16 seq, uint16 than)
+{
+	return (sint16)(seq - than) > 0;
+}
+
+/*
+ * Description :
+ * Key whose current or previous record is on the page, RECORD_NO_KEY if the page is free to reuse.
+ */
+static uint8 RecordStore_owner(uint8 page, uint8 *generation)
+{
+	uint8 key;
+
+	for(key = 0; key < RECORD_STORE_MAX_KEYS; key++)
+	{
+		for(*generation = RECORD_CURRENT; *generation <= RECORD_PREVIOUS; (*generation)++)
+		{
+			if(g_indexPage[key][*generation] == page)
+			{
+				return key;
+			}
+		}
+	}
+	return RECORD_NO_KEY;
+}
+
+/*
+ * Description :
+ * First free page from page on, other than skip. There is always one as the keys own
+ * at most 2 * RECORD_STORE_MAX_KEYS pages.
+ */
+static uint8 RecordStore_freePage(uint8 page, uint8 skip)
+{
+	uint8 generation;
+
+	while((page == skip) || (RecordStore_owner(page, &generation) != RECORD_NO_KEY))
+	{
+		page = RecordStore_nextPage(page);
+	}
+	return page;
+}
+
+/*
+ * Description :
+ * Put a record found by the boot scan in the index if it is one of the two newest of its key.
+ */
+static void RecordStore_addToIndex(uint8 key, uint8 page, uint16 seq)
+{
+	if((g_indexPage[key][RECORD_CURRENT] == RECORD_NO_PAGE) || RecordStore_isNewer(seq, g_indexSeq[key][RECORD_CURRENT]))
+	{
+		g_indexPage[key][RECORD_PREVIOUS] = g_indexPage[key][RECORD_CURRENT];
+		g_indexSeq[key][RECORD_PREVIOUS] = g_indexSeq[key][RECORD_CURRENT];
+		g_indexPage[key][RECORD_CURRENT] = page;
+		g_indexSeq[key][RECORD_CURRENT] = seq;
+	}
+	else if((g_indexPage[key][RECORD_PREVIOUS] == RECORD_NO_PAGE) || RecordStore_isNewer(seq, g_indexSeq[key][RECORD_PREVIOUS]))
+	{
+		g_indexPage[key][RECORD_PREVIOUS] = page;
+		g_indexSeq[key][RECORD_PREVIOUS] = seq;
+	}
+}
+
+/*
+ * Description :
+ * Check a page holds a valid record.
+ */
+static boolean RecordStore_isValid(const uint8 *buffer)
+{
+	return (CRC8_computeFrom(CRC8_STORAGE_INITIAL_VALUE, buffer, RECORD_CRC) == buffer[RECORD_CRC]) &&
+			(buffer[RECORD_KEY] < RECORD_STORE_MAX_KEYS) && (buffer[RECORD_LENGTH] <= RECORD_STORE_PAYLOAD_SIZE);
+}
+
+/*
+ * Description :
+ * Read a page and check it holds a valid record.
+ */
+static uint8 RecordStore_readPage(uint8 page, uint8 *buffer)
+{
+	if((EEPROM_readBuffer(RecordStore_pageAddress(page), buffer, EEPROM_PAGE_SIZE) == ERROR) || !RecordStore_isValid(buffer))
+	{
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+/*
+ * Description :
+ * Write a record with the next sequence number on a page, it becomes the current record of
+ * the key and the current one its previous record.
+ */
+static uint8 RecordStore_writePage(uint8 page, uint8 key, const uint8 *data, uint8 length)
+{
+	uint8 buffer[EEPROM_PAGE_SIZE];
+	uint8 i;
+	uint16 seq = g_seq + 1;
+
+	buffer[RECORD_KEY] = key;
+	buffer[RECORD_SEQ_LOW] = (uint8)seq;
+	buffer[RECORD_SEQ_HIGH] = (uint8)(seq >> 8);
+	buffer[RECORD_LENGTH] = length;
+	for(i = 0; i < RECORD_STORE_PAYLOAD_SIZE; i++)
+	{
+		buffer[RECORD_PAYLOAD + i] = (i < length) ? data[i] : 0xFF;
+	}
+	buffer[RECORD_CRC] = CRC8_computeFrom(CRC8_STORAGE_INITIAL_VALUE, buffer, RECORD_CRC);
+
+	if(EEPROM_writeBuffer(RecordStore_pageAddress(page), buffer, EEPROM_PAGE_SIZE) == ERROR)
+	{
+		return ERROR;
+	}
+	g_seq = seq;
+	RecordStore_addToIndex(key, page, seq);
+	return SUCCESS;
+}
@@ -0,0 +1,93 @@
+/*******************************************************************************
+ *  [FILE NAME]: record_store.h
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 18, 2026
+ *
+ *  [DESCRIPTION]: Header file for the log-structured record store on the external EEPROM
+ *******************************************************************************/
+
+#ifndef RECORD_STORE_H_
+#define RECORD_STORE_H_
+
+#include "std_types.h"
+#include "external_eeprom.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+/*
+ * EEPROM pages the log runs over, one record per page: the lower 1KB of the 2KB 24C16
+ * (pages 0 to 63), the upper half (pages 64 to 127) is the audit log. The keys own at most
+ * 16 pages, the writes go round the 48 others at least, and the audit log keeps 128 entries.
+ */
+#define RECORD_STORE_FIRST_PAGE         0
+#define RECORD_STORE_PAGES              64
+
+/* Keys are 0 to RECORD_STORE_MAX_KEYS - 1, each one costs 6 bytes of RAM for the index */
+#define RECORD_STORE_MAX_KEYS           8
+
+/* A page holds the key, the sequence number (2 bytes), the length, the payload and a CRC-8 */
+#define RECORD_STORE_PAYLOAD_SIZE       (EEPROM_PAGE_SIZE - 5)
+
+/*******************************************************************************
+ *                         Types Declaration                                   *
+ *******************************************************************************/
+/* Sequence number and CRC of a record page, a new write of the key changes them */
+typedef struct{
+	uint16 seq;
+	uint8 crc;
+}RecordStore_Stamp;
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+/*
+ * Every key keeps two generations (A/B slots): its current record and the one before it.
+ * A new record only ever replaces the older of the two, so a write cut by a reset leaves
+ * the current record untouched, and a record found corrupted later falls back to the
+ * previous one.
+ */
+
+/*
+ * Description: A function that scans the log in one pass and builds the RAM index of the
+ * 	two newest valid records of every key. Pages with a wrong CRC (never written, or a write
+ * 	cut by a reset) are ignored.
+ *
+ * Restrictions: - must be called after TWI_init, with the interrupts enabled.
+ * */
+void RecordStore_init(void);
+
+/*
+ * Description: A function that appends a new record for key to the log in a single page
+ * 	write, the record it replaces becomes the previous generation. The log is written round
+ * 	all its pages in turn; where it comes round to a page another key still needs, that
+ * 	key's current record is first copied forward, so static records take their share of
+ * 	the writes and the oldest page is always free to reuse.
+ * 	Returns SUCCESS, or ERROR for a bad key or length or an EEPROM failure.
+ * */
+uint8 RecordStore_write(uint8 key, const uint8 *data, uint8 length);
+
+/*
+ * Description: A function that reads the current record of key into data (up to
+ * 	RECORD_STORE_PAYLOAD_SIZE bytes) and its length into length, or the previous record if
+ * 	the current one does not pass its CRC any more.
+ * 	Returns ERROR if the key has no valid record or the EEPROM read fails.
+ * */
+uint8 RecordStore_read(uint8 key, uint8 *data, uint8 *length);
+
+/*
+ * Description: A function that tells if key has a record, from the RAM index.
+ * */
+boolean RecordStore_contains(uint8 key);
+
+/*
+ * Description: A function that reads the stamp of the current record of key from the EEPROM,
+ * 	3 bytes instead of the whole page: a RAM copy of the record taken with its stamp is still
+ * 	the record in the EEPROM as long as the stamp read again is the same.
+ * 	Returns ERROR if the key has no record or the EEPROM read fails.
+ * */
+uint8 RecordStore_readStamp(uint8 key, RecordStore_Stamp *stamp);
+
+#endif /* RECORD_STORE_H_ */
@@ -0,0 +1,154 @@
+ /******************************************************************************
+ *
+ * Module: SPSC_QUEUE
+ *
+ * File Name: spsc_queue.h
+ *
+ * Description: Lock-free single-producer/single-consumer byte queue for handing data
+ *              between an interrupt and the main loop
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include "std_types.h"
+
+/*
+ * One side (an ISR or the main loop) only pushes and the other side only pops, then no
+ * interrupt has to be disabled: the producer alone writes head and the consumer alone
+ * writes tail, both are 8-bit so they are read and written in one instruction on AVR.
+ * The indices run freely and wrap at 256, the size is a power of two up to 128 so
+ * head - tail is the number of queued bytes and the whole buffer can be used.
+ * Records of several bytes are written and read all at once with SpscQueue_write/read.
+ *
+ * Usage:
+ * 	static uint8 g_buffer[32];
+ * 	static SpscQueue g_queue = SPSC_QUEUE_INITIALIZER(g_buffer);
+ */
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+#define SPSC_QUEUE_MAX_SIZE             128
+
+/* TRUE if SIZE can be used as the size of a queue buffer */
+#define SPSC_QUEUE_SIZE_IS_VALID(SIZE)  \
+	(((SIZE) >= 2) && ((SIZE) <= SPSC_QUEUE_MAX_SIZE) && (((SIZE) & ((SIZE) - 1)) == 0))
+
+#define SPSC_QUEUE_INITIALIZER(BUFFER)  { (BUFFER), sizeof(BUFFER) - 1, 0, 0 }
+
+/*
+ * The data has to be in the buffer before the other side sees the index move, and read out
+ * of it before the slot is handed back. The AVR is a single in-order core so only the compiler
+ * must be kept from moving memory accesses across the index updates. A host build of the
+ * queue (tests on a multi-core PC) needs a real fence.
+ */
+#if defined(__AVR__)
+#define SPSC_QUEUE_BARRIER()            __asm__ __volatile__("" ::: "memory")
+#else
+#define SPSC_QUEUE_BARRIER()            __sync_synchronize()
+#endif
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+typedef struct
+{
+	uint8 *buffer;
+	uint8 mask;             /* buffer size - 1 */
+	volatile uint8 head;    /* written by the producer only */
+	volatile uint8 tail;    /* written by the consumer only */
+}SpscQueue;
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+/*
+ * Description: Number of bytes in the queue, from either side.
+ * */
+static inline uint8 SpscQueue_count(const SpscQueue *queue)
+{
+	return (uint8)(queue->head - queue->tail);
+}
+
+/*
+ * Description: Number of bytes that can still be pushed, from either side.
+ * */
+static inline uint8 SpscQueue_space(const SpscQueue *queue)
+{
+	return (uint8)(queue->mask + 1 - SpscQueue_count(queue));
+}
+
+/*
+ * Description: Producer side, add len bytes to the queue.
+ * 	Return FALSE without adding anything if there is no room for all of them.
+ * */
+static inline boolean SpscQueue_write(SpscQueue *queue, const uint8 *data, uint8 len)
+{
+	uint8 head = queue->head;
+	uint8 i;
+
+	if(len > SpscQueue_space(queue))
+	{
+		return FALSE;
+	}
+	for(i = 0; i < len; i++)
+	{
+		queue->buffer[(uint8)(head + i) & queue->mask] = data[i];
+	}
+	SPSC_QUEUE_BARRIER(); /* data before index */
+	queue->head = head + len;
+	return TRUE;
+}
+
+/*
+ * Description: Producer side, add one byte to the queue, return FALSE if it is full.
+ * */
+static inline boolean SpscQueue_push(SpscQueue *queue, uint8 data)
+{
+	return SpscQueue_write(queue, &data, 1);
+}
+
+/*
+ * Description: Consumer side, take len bytes out of the queue.
+ * 	Return FALSE without taking anything if it holds fewer bytes.
+ * */
+static inline boolean SpscQueue_read(SpscQueue *queue, uint8 *data, uint8 len)
+{
+	uint8 tail = queue->tail;
+	uint8 i;
+
+	if(len > SpscQueue_count(queue))
+	{
+		return FALSE;
+	}
+	SPSC_QUEUE_BARRIER(); /* index before data */
+	for(i = 0; i < len; i++)
+	{
+		data[i] = queue->buffer[(uint8)(tail + i) & queue->mask];
+	}
+	SPSC_QUEUE_BARRIER(); /* data out before the slots are handed back */
+	queue->tail = tail + len;
+	return TRUE;
+}
+
+/*
+ * Description: Consumer side, take one byte out of the queue, return FALSE if it is empty.
+ * */
+static inline boolean SpscQueue_pop(SpscQueue *queue, uint8 *data)
+{
+	return SpscQueue_read(queue, data, 1);
+}
+
+/*
+ * Description: Consumer side, TRUE if there is nothing to take out.
+ * */
+static inline boolean SpscQueue_isEmpty(const SpscQueue *queue)
+{
+	return queue->head == queue->tail;
+}
+
+#endif /* SPSC_QUEUE_H_ */
@@ -0,0 +1,72 @@
+/*******************************************************************************
+ *  [FILE NAME]: supervisor.h
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 17, 2026
+ *
+ *  [DESCRIPTION]: Header file for the watchdog backed task supervisor
+ *******************************************************************************/
+
+#ifndef SUPERVISOR_H_
+#define SUPERVISOR_H_
+
+#include "std_types.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+#define SUPERVISOR_MAX_TASKS            4
+/* Period of the deadline check, it is also the period the watchdog is served at */
+#define SUPERVISOR_CHECK_PERIOD_MS      100
+/* Watchdog period (avr/wdt.h WDTO_ value), catches a hang with the interrupts disabled */
+#define SUPERVISOR_WATCHDOG_TIMEOUT     WDTO_500MS
+
+/* lastMissedTask value when no deadline was missed */
+#define SUPERVISOR_NO_TASK              0xFF
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+/* What is known about the resets, kept in RAM through them */
+typedef struct
+{
+	uint8 resetCause;                           /* MCUCSR flags of the last reset */
+	uint16 resetCount;                          /* resets since power-on */
+	uint16 watchdogTimeouts;                    /* resets by the watchdog not ordered by the supervisor */
+	uint8 lastMissedTask;                       /* task that caused the last supervisor reset */
+	uint16 missCounts[SUPERVISOR_MAX_TASKS];    /* missed deadlines per task since power-on */
+}Supervisor_Record;
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+/*
+ * Description: A function that reads the cause of the last reset, enables the watchdog and starts
+ * 	checking the task deadlines on a software timer. safeStateCallBack (may be NULL_PTR) is called
+ * 	before the supervisor resets the MCU to put the outputs in a safe state.
+ *
+ * Restrictions: - must be called early in main, after SwTimer_init.
+ * 				 - the check runs in the Timer1 interrupt, so it catches a task stuck in a loop but not
+ * 				   one stuck with the interrupts disabled, which the watchdog resets without the call-back.
+ * */
+void Supervisor_init(void (*safeStateCallBack)(void));
+
+/*
+ * Description: A function that adds a task that has to check in at least every deadline_ms,
+ * 	returns its id (SUPERVISOR_NO_TASK if there are too many tasks).
+ * 	The deadline starts counting at once.
+ * */
+uint8 Supervisor_addTask(uint16 deadline_ms);
+
+/*
+ * Description: A function that tells the supervisor the task is alive.
+ * */
+void Supervisor_checkIn(uint8 task);
+
+/*
+ * Description: A function that copies the reset record.
+ * */
+void Supervisor_getRecord(Supervisor_Record *record);
+
+#endif /* SUPERVISOR_H_ */
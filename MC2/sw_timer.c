@@ -0,0 +1,244 @@
+/*******************************************************************************
+ *  [FILE NAME]: sw_timer.c
+ *
+ *  [Author]: Hisham Elsayed
+ *
+ *  [DATE CREATED]: Oct 17, 2026
+ *
+ *  [DESCRIPTION]: Source file for the software timers service running on Timer1
+ *******************************************************************************/
+
+#include "sw_timer.h"
+#include "timer.h"
+#include "power.h"
+#include "avr/interrupt.h" /* For ISR */
+#include "util/atomic.h" /* For ATOMIC_BLOCK */
+
+#if ((SW_TIMER_WHEEL_SIZE & (SW_TIMER_WHEEL_SIZE - 1)) != 0)
+#error "SW_TIMER_WHEEL_SIZE must be a power of two"
+#endif
+
+#define SW_TIMER_WHEEL_MASK         (SW_TIMER_WHEEL_SIZE - 1)
+
+#if (SW_TIMER_TICK_MS != 1)
+#error "the software timers tick on the 1 ms compare interrupt of the Timer1 monotonic clock"
+#endif
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* Each slot holds a doubly linked list of the timers expiring on a tick that maps to it */
+static SwTimer *g_wheel[SW_TIMER_WHEEL_SIZE];
+static volatile uint32 g_ticks = 0;
+
+/*******************************************************************************
+ *                      Functions Prototypes(Private)                          *
+ *******************************************************************************/
+static void SwTimer_link(SwTimer *timer);
+static void SwTimer_unlink(SwTimer *timer);
+static void SwTimer_expireSlot(uint8 slot);
+static inline boolean SwTimer_tick(void);
+static void SwTimer_expire(void);
+
+/*******************************************************************************
+ *                        Interrupt Service Routines                           *
+ *******************************************************************************/
+#if (TIMER1_COMPA_BINDING == TIMER_BINDING_STATIC)
+/* The wheel tick is inlined in the Timer1 compare ISR, the timers are fired from the compare B ISR */
+TIMER1_COMPA_BIND_STATIC(SwTimer_tick,SwTimer_expire)
+#endif
+
+/*******************************************************************************
+ *                         Function Definitions                                *
+ *******************************************************************************/
+void SwTimer_init(void)
+{
+	uint8 slot;
+
+	for(slot = 0; slot < SW_TIMER_WHEEL_SIZE; slot++)
+	{
+		g_wheel[slot] = NULL_PTR;
+	}
+	g_ticks = 0;
+
+	Timer_startClock(SwTimer_expire);
+}
+
+void SwTimer_start(SwTimer *timer, uint16 period_ms, SwTimer_mode mode, void (*callBackPtr)(void))
+{
+	uint16 period = period_ms / SW_TIMER_TICK_MS;
+
+	if(period == 0)
+	{
+		period = 1;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(timer->active)
+		{
+			SwTimer_unlink(timer);
+		}
+		timer->period = period;
+		timer->mode = mode;
+		timer->callBackPtr = callBackPtr;
+		/* The wheel may lag behind the clock right after an idle period, so count from the clock */
+		timer->expiry = Timer_getMillis() + period;
+		SwTimer_link(timer);
+	}
+}
+
+void SwTimer_cancel(SwTimer *timer)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(timer->active)
+		{
+			SwTimer_unlink(timer);
+		}
+	}
+}
+
+boolean SwTimer_isActive(const SwTimer *timer)
+{
+	return timer->active;
+}
+
+uint32 SwTimer_ticksToNextExpiry(void)
+{
+	uint32 nearest = 0xFFFFFFFF;
+	uint32 remaining;
+	uint8 slot;
+	const SwTimer *timer;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for(slot = 0; slot < SW_TIMER_WHEEL_SIZE; slot++)
+		{
+			for(timer = g_wheel[slot]; timer != NULL_PTR; timer = timer->next)
+			{
+				remaining = timer->expiry - g_ticks;
+				if(remaining < nearest)
+				{
+					nearest = remaining;
+				}
+			}
+		}
+	}
+	return nearest;
+}
+
+/*
+ * Description: Push the timer at the head of the wheel slot of its expiry tick.
+ * 	Must be called with interrupts disabled.
+ * */
+static void SwTimer_link(SwTimer *timer)
+{
+	SwTimer **slot = &g_wheel[timer->expiry & SW_TIMER_WHEEL_MASK];
+
+	timer->prev = NULL_PTR;
+	timer->next = *slot;
+	if(*slot != NULL_PTR)
+	{
+		(*slot)->prev = timer;
+	}
+	*slot = timer;
+	timer->active = TRUE;
+}
+
+/*
+ * Description: Remove the timer from its wheel slot.
+ * 	Must be called with interrupts disabled.
+ * */
+static void SwTimer_unlink(SwTimer *timer)
+{
+	if(timer->prev != NULL_PTR)
+	{
+		timer->prev->next = timer->next;
+	}
+	else
+	{
+		g_wheel[timer->expiry & SW_TIMER_WHEEL_MASK] = timer->next;
+	}
+	if(timer->next != NULL_PTR)
+	{
+		timer->next->prev = timer->prev;
+	}
+	timer->active = FALSE;
+}
+
+/*
+ * Description: Timer1 compare handler of the static binding, advances the wheel one slot per
+ * 	elapsed millisecond (several after a stretched idle period) over the empty slots. It makes
+ * 	no call, so the ISR saves only the registers it uses. Returns TRUE at a slot holding timers,
+ * 	SwTimer_expire takes over from there.
+ * */
+static inline boolean SwTimer_tick(void)
+{
+	uint32 now = Timer_getMillisFromIsr();
+
+	while(g_ticks != now)
+	{
+		if(g_wheel[(uint8)(g_ticks + 1) & SW_TIMER_WHEEL_MASK] != NULL_PTR)
+		{
+			return TRUE;
+		}
+		g_ticks++;
+	}
+	return FALSE;
+}
+
+/*
+ * Description: Timer1 call-back, advances the wheel one slot per elapsed millisecond and fires
+ * 	the timers of the slots on the way. The whole tick with the dynamic binding, the part after
+ * 	SwTimer_tick with the static one.
+ * */
+static void SwTimer_expire(void)
+{
+	uint32 now = Timer_getMillisFromIsr();
+	uint8 slot;
+
+	while(g_ticks != now)
+	{
+		g_ticks++;
+		slot = g_ticks & SW_TIMER_WHEEL_MASK;
+		if(g_wheel[slot] != NULL_PTR)
+		{
+			SwTimer_expireSlot(slot);
+		}
+	}
+}
+
+/*
+ * Description: Fires the timers of a wheel slot expiring on the current tick.
+ * 	Timers of the same slot expiring on a later turn of the wheel are skipped.
+ * */
+static void SwTimer_expireSlot(uint8 slot)
+{
+	SwTimer *timer = g_wheel[slot];
+
+	while(timer != NULL_PTR)
+	{
+		if(timer->expiry != g_ticks)
+		{
+			timer = timer->next;
+			continue;
+		}
+
+		SwTimer_unlink(timer);
+		if(timer->mode == SW_TIMER_PERIODIC)
+		{
+			timer->expiry += timer->period;
+			SwTimer_link(timer);
+		}
+		if(timer->callBackPtr != NULL_PTR)
+		{
+			timer->callBackPtr();
+		}
+		/* Whoever waits on this timer has something to do, do not go back to sleep */
+		Power_signalEvent();
+
+		/* The call-back may have started or cancelled timers, so walk the slot again */
+		timer = g_wheel[slot];
+	}
+}
@@ -13,146 +13,48 @@
 #include "common_macros.h" /* To use the macros like SET_BIT */
 #include "avr/io.h" /* To use the IO Ports Registers */
 #include "avr/interrupt.h"
+#include "util/atomic.h" /* For ATOMIC_BLOCK */
+
+#if (TIMER_CLOCK_COUNTS_PER_US == 0) || ((F_CPU % 8000000UL) != 0)
+#error "the Timer1 monotonic clock needs F_CPU to be a multiple of 8 MHz"
+#endif
 
 /*******************************************************************************
  *                           Global Variables                                  *
  *******************************************************************************/
-/* Global variables to hold the address of the call back function in the application */
-static volatile void (*g_Timer0CallBackPtr)(void) = NULL_PTR;
-static volatile void (*g_Timer1CallBackPtr)(void) = NULL_PTR;
-static volatile void (*g_Timer2CallBackPtr)(void) = NULL_PTR;
+/* Address of the clock call-back function in the application, with the dynamic binding */
+static void (*volatile g_Timer1CallBackPtr)(void) = NULL_PTR;
+
+/* Milliseconds counted by the Timer1 compare interrupt while the monotonic clock runs */
+volatile uint32 g_Timer1Millis = 0;
+volatile boolean g_Timer1ClockRunning = FALSE;
+/* Milliseconds covered by the current compare period, more than 1 while the clock is stretched */
+volatile uint8 g_Timer1ClockStep = 1;
+
+#if (TIMER_MEASURE_ISR_CYCLES == 1)
+volatile uint16 g_Timer1IsrCycles = 0;
+volatile uint16 g_Timer1IsrMaxCycles = 0;
+#endif
 
 /*******************************************************************************
  *                        Interrupt Service Routines                           *
  ******************************************************************************/
-/* Timer0 OVF mode */
-ISR(TIMER0_OVF_vect)
-{
-	if (g_Timer0CallBackPtr != NULL_PTR) {
-		(*g_Timer0CallBackPtr)();
-	}
-}
-
-/* Timer0 CTC mode */
-ISR(TIMER0_COMP_vect)
-{
-	if (g_Timer0CallBackPtr != NULL_PTR) {
-		(*g_Timer0CallBackPtr)();
-	}
-}
-
-/* Timer1 OVF mode */
-ISR(TIMER1_OVF_vect)
-{
-	if (*g_Timer1CallBackPtr != NULL_PTR) {
-		(*g_Timer1CallBackPtr)();
-	}
-}
-
+#if (TIMER1_COMPA_BINDING == TIMER_BINDING_DYNAMIC)
 /* Timer1 CTC mode */
 ISR(TIMER1_COMPA_vect)
 {
-	if (*g_Timer1CallBackPtr != NULL_PTR)
+	Timer_clockTick();
+	if (g_Timer1CallBackPtr != NULL_PTR)
 	{
 		(*g_Timer1CallBackPtr)();
 	}
+	TIMER1_ISR_CYCLES_END();
 }
-
-/* Timer2 OVF mode */
-ISR(TIMER2_OVF_vect)
-{
-	if (g_Timer2CallBackPtr != NULL_PTR) {
-		(*g_Timer2CallBackPtr)();
-	}
-}
-/* Timer2 CTC mode */
-ISR(TIMER2_COMP_vect)
-{
-	if (g_Timer2CallBackPtr != NULL_PTR) {
-		(*g_Timer2CallBackPtr)();
-	}
-}
+#endif
 
 /*******************************************************************************
  *                         Function Definitions                                *
  *******************************************************************************/
-void Timer_init(const Timer_Config* TimerConfig)
-{
-	if( (TimerConfig->type) == Timer0 )
-	{
-		/* starting with adjusting common bits for the timer, then mode-specific bits */
-		TCCR0 |= (1<<FOC0);
-		TCNT0 = TimerConfig -> initialvalue;
-		TCCR0 = 0;
-		TCCR0 = (TCCR0 & 0xF8) | ((TimerConfig -> prescale) & 0x07);
-
-		if(TimerConfig -> mode == Normal )
-		{
-			/* Enable interrupts for overflow mode */
-			SET_BIT(TIMSK,TOIE0);
-			/* Enable overflow flag */
-			SET_BIT(TIFR,TOV0);
-		}
-		else if (TimerConfig -> mode == CTC )
-		{
-			SET_BIT(TCCR0,WGM01);
-			OCR0 = TimerConfig -> comparevalue;
-			SET_BIT(TIMSK,OCIE0); /* enable interrupts for CTC mode */
-			SET_BIT(TIFR,OCF0); /* enable CTC flag */
-		}
-		g_Timer0CallBackPtr = TimerConfig -> callBackPtr;
-	}
-
-	else if ( (TimerConfig -> type) == Timer1 )
-	{
-		TCCR1A =0;
-		SET_BIT(TCCR1A,FOC1A); /* for non-PWM mode */
-		SET_BIT(TCCR1A,FOC1B);
-		TCCR1B = TimerConfig->prescale;
-		TCNT1 = TimerConfig->initialvalue;
-
-		if( (TimerConfig -> mode) == Normal )
-		{
-			/* Enable interrupts for overflow mode */
-			SET_BIT(TIMSK,TOIE1);
-			/* Enable overflow flag */
-			SET_BIT(TIFR,TOV1);
-		}
-		else if ( (TimerConfig -> mode) == CTC )
-		{
-			SET_BIT(TCCR1B,WGM12);
-			OCR1A = TimerConfig -> comparevalue;
-			SET_BIT(TIMSK,OCIE1A); /* enable interrupts for CTC mode */
-			SET_BIT(TIFR,OCF1A); /* enable CTC flag */
-		}
-		g_Timer1CallBackPtr = TimerConfig -> callBackPtr;
-	}
-
-	else if (TimerConfig -> type == Timer2 )
-	{
-		SET_BIT(TCCR2, FOC2); /* for non-PWM */
-		TCNT2 = TimerConfig -> initialvalue;
-		TCCR2 = 0;
-		TCCR2 |= (TimerConfig -> prescale);
-
-		if((TimerConfig -> mode) == Normal )
-		{
-			/* Enable interrupts for overflow mode */
-			SET_BIT(TIMSK,TOIE2);
-			/* Enable overflow flag */
-			SET_BIT(TIFR,TOV2);
-		}
-		else if ( (TimerConfig -> mode) == CTC )
-		{
-			SET_BIT(TCCR1B,WGM21);
-			OCR1A = TimerConfig -> comparevalue;
-			SET_BIT(TIMSK,OCIE2); /* enable interrupts for CTC mode */
-			SET_BIT(TIFR,OCF2); /* enable CTC flag */
-		}
-		g_Timer2CallBackPtr = TimerConfig -> callBackPtr;
-	}
-}
-
 void Timer_deinit(Timer_type type)
 {
 	if ( type == Timer0 )
@@ -162,7 +64,6 @@ void Timer_deinit(Timer_type type)
 		OCR0 = 0; /* clear compare value for CTC mode*/
 		CLEAR_BIT(TIMSK,OCIE0); /* disable interrupts for CTC mode */
 		CLEAR_BIT(TIMSK,TOIE0); /* disable interrupts for overflow mode */
-		g_Timer0CallBackPtr = NULL_PTR; /* clear the call-back function */
 	}
 	else if ( type == Timer1 )
 	{
@@ -172,7 +73,9 @@ void Timer_deinit(Timer_type type)
 		CLEAR_BIT(TIMSK, TOIE1); /* disable interrupts for overflow mode */
 		OCR1A = 0;  /* clear compare value for CTC mode */
 		CLEAR_BIT(TIMSK, OCIE1A); /* disable interrupts for CTC mode */
+		CLEAR_BIT(TIMSK, OCIE1B); /* disable the deferred part of the tick */
 		g_Timer1CallBackPtr = NULL_PTR;
+		g_Timer1ClockRunning = FALSE;
 	}
 	else if ( type == Timer2 )
 	{
@@ -181,9 +84,117 @@ void Timer_deinit(Timer_type type)
 		OCR2 = 0; /* clear compare value for CTC mode*/
 		CLEAR_BIT(TIMSK, OCIE2); /* disable interrupts for CTC mode */
 		CLEAR_BIT(TIMSK, TOIE2); /* disable interrupts for overflow mode */
-		g_Timer2CallBackPtr = NULL_PTR;
 	}
 }
 
+void Timer_startClock(void (*tickCallBackPtr)(void))
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		g_Timer1Millis = 0;
+		g_Timer1ClockStep = 1;
+		g_Timer1ClockRunning = TRUE;
+		g_Timer1CallBackPtr = tickCallBackPtr;
+		/* 1 ms period at F_CPU/8, checked and computed at compile time */
+		TIMER1_CTC_INIT_CS(1000, TIMER_CLOCK_CS);
+		/* compare B matches at the start of every period, for the deferred part of the static binding */
+		OCR1B = 0;
+	}
+}
 
+uint32 Timer_getMillis(void)
+{
+	uint32 millis;
+	uint16 counts;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		millis = g_Timer1Millis;
+		counts = TCNT1;
+		/* The counter restarted but the interrupt counting that period is still pending */
+		if (BIT_IS_SET(TIFR,OCF1A))
+		{
+			millis += g_Timer1ClockStep;
+			counts = TCNT1;
+		}
+	}
+	/* while the clock is stretched TCNT1 spans several milliseconds */
+	return millis + (counts / TIMER_CLOCK_COUNTS_PER_MS);
+}
+
+uint32 Timer_getMicros(void)
+{
+	uint32 millis;
+	uint16 counts;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		millis = g_Timer1Millis;
+		counts = TCNT1;
+		/* The counter restarted but the interrupt counting that period is still pending */
+		if (BIT_IS_SET(TIFR,OCF1A))
+		{
+			millis += g_Timer1ClockStep;
+			counts = TCNT1;
+		}
+	}
+	return (millis * 1000UL) + (counts / TIMER_CLOCK_COUNTS_PER_US);
+}
+
+void Timer_stretchClock(uint8 period_ms)
+{
+	if (period_ms > TIMER_CLOCK_MAX_STRETCH_MS)
+	{
+		period_ms = TIMER_CLOCK_MAX_STRETCH_MS;
+	}
 
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		/* a pending compare interrupt would account the new period instead of the elapsed one */
+		if (g_Timer1ClockRunning && (period_ms > 1) && (g_Timer1ClockStep == 1) && BIT_IS_CLEAR(TIFR,OCF1A))
+		{
+			g_Timer1ClockStep = period_ms;
+			OCR1A = ((uint16)period_ms * TIMER_CLOCK_COUNTS_PER_MS) - 1;
+		}
+	}
+}
+
+void Timer_restoreClock(void)
+{
+	uint16 counts;
+	uint8 elapsed;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if ((g_Timer1ClockStep == 1) || BIT_IS_SET(TIFR,OCF1A))
+		{
+			return;
+		}
+
+		/* end the period on the next millisecond boundary, keeping a margin so the compare is not missed */
+		counts = TCNT1;
+		elapsed = (counts / TIMER_CLOCK_COUNTS_PER_MS) + 1;
+		if (((uint16)elapsed * TIMER_CLOCK_COUNTS_PER_MS - counts) < (TIMER_CLOCK_COUNTS_PER_MS / 16))
+		{
+			elapsed++;
+		}
+		if (elapsed < g_Timer1ClockStep)
+		{
+			g_Timer1ClockStep = elapsed;
+			OCR1A = ((uint16)elapsed * TIMER_CLOCK_COUNTS_PER_MS) - 1;
+		}
+	}
+}
+
+#if (TIMER_MEASURE_ISR_CYCLES == 1)
+uint16 Timer_getIsrCycles(boolean max)
+{
+	uint16 cycles;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		cycles = max ? g_Timer1IsrMaxCycles : g_Timer1IsrCycles;
+	}
+	return cycles;
+}
+#endif
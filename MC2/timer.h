@@ -12,52 +12,292 @@
 #define TIMER_H_
 
 #include "std_types.h"
+#include "common_macros.h" /* For SET_BIT in the _INIT macros */
+#include "avr/io.h" /* For the inline clock tick */
 
 /*******************************************************************************
- *                               Types Declaration                             *
+ *                                Definitions                                  *
  *******************************************************************************/
+/* Clock select values (CS bits) of Timer0 and Timer1 */
+#define TIMER_CS_DIV_1                  1
+#define TIMER_CS_DIV_8                  2
+#define TIMER_CS_DIV_64                 3
+#define TIMER_CS_DIV_256                4
+#define TIMER_CS_DIV_1024               5
 
-typedef enum{
-	Timer0, Timer1, Timer2
-}Timer_type;
+/* Highest error accepted between the requested and the generated period (in parts per million) */
+#define TIMER_MAX_ERROR_PPM             1000
 
-typedef enum
-{
-	Normal, CTC
-}Timer_mode;
+/*
+ * Monotonic clock on Timer1: CTC mode with F_CPU/8 (1 MHz at 8 MHz) so TCNT1 counts
+ * microseconds and the compare interrupt fires every millisecond.
+ */
+#define TIMER_CLOCK_CS                  TIMER_CS_DIV_8
+#define TIMER_CLOCK_COUNTS_PER_MS       (F_CPU / 8UL / 1000UL)
+#define TIMER_CLOCK_COUNTS_PER_US       (F_CPU / 8UL / 1000000UL)
 
-typedef enum
-{
-	No_clock,No_prescaling,Prescale_8,Prescale_64,Prescale_256,Prescale_1024
-}Timer_clock;
+/* Longest period the clock interrupt can be stretched to while the CPU is idle (65 ms at 8 MHz) */
+#define TIMER_CLOCK_MAX_STRETCH_MS      (65535UL / TIMER_CLOCK_COUNTS_PER_MS)
 
-typedef struct
-{
-		Timer_type type;
-		Timer_mode mode;
-		uint16 initialvalue;
-		uint16 comparevalue;
-		Timer_clock prescale;
-		void (*callBackPtr)(void);
-}Timer_Config;
+/*
+ * Binding of the Timer1 compare (clock) interrupt handler:
+ * TIMER_BINDING_DYNAMIC: the ISR in timer.c calls the function given to Timer_startClock through
+ *                        a pointer, so it has to save every call-clobbered register on each tick.
+ * TIMER_BINDING_STATIC:  the module owning the handlers defines the ISRs with TIMER1_COMPA_BIND_STATIC.
+ *                        The clock update and the tick handler are inlined and make no call, so on a
+ *                        tick with nothing to fire the ISR saves only the registers it uses. A tick
+ *                        that fires timers goes on in the compare B ISR, saving them all like the
+ *                        dynamic binding.
+ *
+ * The cycles per tick have not been measured, there was no AVR toolchain or board at hand: set
+ * TIMER_MEASURE_ISR_CYCLES to 1 and read Timer_getIsrCycles with each binding to get them.
+ * From the instruction timings alone, the call costs the push and pop of up to 12 call-clobbered
+ * registers (r18-r27, r30, r31) the body would not use, up to 48 cycles, plus about 10 for the
+ * pointer load, the indirect call and the return.
+ */
+#define TIMER_BINDING_DYNAMIC           0
+#define TIMER_BINDING_STATIC            1
+#define TIMER1_COMPA_BINDING            TIMER_BINDING_STATIC
+
+/*
+ * Set to 1 to record the cycles spent from the compare match to the end of the Timer1 compare ISR
+ * body (interrupt latency + prologue + body, the epilogue is not included), of the compare B ISR on
+ * the ticks it runs, read with Timer_getIsrCycles.
+ */
+#define TIMER_MEASURE_ISR_CYCLES        0
 
 /*******************************************************************************
- *                      Functions Prototypes                                   *
+ *                      Compile-time Configuration                             *
  *******************************************************************************/
 /*
- * Description: A function that initialize a timer with dynamic configurations.
- *
- * Restrictions: - for Timer1 CTC mode, it's configured to control channel A.
- * 				 - support normal port operations, disable any timer-related pins.
+ * Given F_CPU and a period in microseconds the following macros pick the smallest prescaler
+ * whose compare value fits in the timer, compute that compare value and the timing error.
+ * They are constant expressions so nothing of it is left for run time, and the _INIT macros
+ * expand to straight-line register writes that fail to build for an impossible or inaccurate
+ * period. The interrupt handler is bound at compile time with TIMER0_COMP_BIND/TIMER2_COMP_BIND.
+ */
+
+/* Division factor of a Timer0/Timer1 clock select value */
+#define TIMER01_DIV(CS) \
+	((CS) == 1 ? 1ULL : (CS) == 2 ? 8ULL : (CS) == 3 ? 64ULL : (CS) == 4 ? 256ULL : 1024ULL)
+
+/* Division factor of a Timer2 clock select value (Timer2 has the extra /32 and /128 steps) */
+#define TIMER2_DIV(CS) \
+	((CS) == 1 ? 1ULL : (CS) == 2 ? 8ULL : (CS) == 3 ? 32ULL : (CS) == 4 ? 64ULL : \
+	 (CS) == 5 ? 128ULL : (CS) == 6 ? 256ULL : 1024ULL)
+
+/* Timer counts of a period at a division factor, rounded to the nearest count */
+#define TIMER_COUNTS(PERIOD_US,DIV) \
+	((((unsigned long long)(F_CPU) * (PERIOD_US)) + ((DIV) * 500000ULL)) / ((DIV) * 1000000ULL))
+
+/* Error of the generated period in parts per million */
+#define TIMER_ERROR_PPM(PERIOD_US,DIV) \
+	(TIMER_ABS_DIFF(TIMER_COUNTS(PERIOD_US,DIV) * (DIV) * 1000000ULL, (unsigned long long)(F_CPU) * (PERIOD_US)) \
+	 * 1000000ULL / ((unsigned long long)(F_CPU) * (PERIOD_US)))
+#define TIMER_ABS_DIFF(A,B)             (((A) > (B)) ? ((A) - (B)) : ((B) - (A)))
+
+#define TIMER_FITS(PERIOD_US,DIV,TOP)   ((TIMER_COUNTS(PERIOD_US,DIV) >= 1) && (TIMER_COUNTS(PERIOD_US,DIV) <= (TOP)))
+
+/* Smallest clock select value whose compare value fits, 0 if the period is too long */
+#define TIMER0_CS(PERIOD_US) \
+	(TIMER_FITS(PERIOD_US,1ULL,256ULL) ? 1 : TIMER_FITS(PERIOD_US,8ULL,256ULL) ? 2 : \
+	 TIMER_FITS(PERIOD_US,64ULL,256ULL) ? 3 : TIMER_FITS(PERIOD_US,256ULL,256ULL) ? 4 : \
+	 TIMER_FITS(PERIOD_US,1024ULL,256ULL) ? 5 : 0)
+#define TIMER1_CS(PERIOD_US) \
+	(TIMER_FITS(PERIOD_US,1ULL,65536ULL) ? 1 : TIMER_FITS(PERIOD_US,8ULL,65536ULL) ? 2 : \
+	 TIMER_FITS(PERIOD_US,64ULL,65536ULL) ? 3 : TIMER_FITS(PERIOD_US,256ULL,65536ULL) ? 4 : \
+	 TIMER_FITS(PERIOD_US,1024ULL,65536ULL) ? 5 : 0)
+#define TIMER2_CS(PERIOD_US) \
+	(TIMER_FITS(PERIOD_US,1ULL,256ULL) ? 1 : TIMER_FITS(PERIOD_US,8ULL,256ULL) ? 2 : \
+	 TIMER_FITS(PERIOD_US,32ULL,256ULL) ? 3 : TIMER_FITS(PERIOD_US,64ULL,256ULL) ? 4 : \
+	 TIMER_FITS(PERIOD_US,128ULL,256ULL) ? 5 : TIMER_FITS(PERIOD_US,256ULL,256ULL) ? 6 : \
+	 TIMER_FITS(PERIOD_US,1024ULL,256ULL) ? 7 : 0)
+
+/* Compare register value of a CTC period with a given clock select value */
+#define TIMER01_COMPARE(PERIOD_US,CS)   (TIMER_COUNTS(PERIOD_US,TIMER01_DIV(CS)) - 1)
+#define TIMER2_COMPARE(PERIOD_US,CS)    (TIMER_COUNTS(PERIOD_US,TIMER2_DIV(CS)) - 1)
+
+/*
+ * Timer1 CTC mode (channel A) interrupting every PERIOD_US with a given clock select value.
+ * The interrupt is enabled and a stale compare flag is cleared.
+ */
+#define TIMER1_CTC_INIT_CS(PERIOD_US,CS) do { \
+	_Static_assert(TIMER_FITS(PERIOD_US,TIMER01_DIV(CS),65536ULL), "Timer1: period does not fit with this prescaler"); \
+	_Static_assert(TIMER_ERROR_PPM(PERIOD_US,TIMER01_DIV(CS)) <= TIMER_MAX_ERROR_PPM, "Timer1: period error too high"); \
+	TCCR1A = (1<<FOC1A) | (1<<FOC1B); \
+	TCNT1 = 0; \
+	OCR1A = TIMER01_COMPARE(PERIOD_US,CS); \
+	TCCR1B = (1<<WGM12) | (CS); \
+	TIFR = (1<<OCF1A); \
+	SET_BIT(TIMSK,OCIE1A); \
+} while(0)
+
+/* Timer1 CTC mode with the prescaler picked automatically */
+#define TIMER1_CTC_INIT(PERIOD_US) do { \
+	_Static_assert(TIMER1_CS(PERIOD_US) != 0, "Timer1: period too long"); \
+	TIMER1_CTC_INIT_CS(PERIOD_US,TIMER1_CS(PERIOD_US)); \
+} while(0)
+
+/* Timer0 CTC mode interrupting every PERIOD_US, prescaler picked automatically */
+#define TIMER0_CTC_INIT(PERIOD_US) do { \
+	_Static_assert(TIMER0_CS(PERIOD_US) != 0, "Timer0: period too long"); \
+	_Static_assert(TIMER_ERROR_PPM(PERIOD_US,TIMER01_DIV(TIMER0_CS(PERIOD_US))) <= TIMER_MAX_ERROR_PPM, "Timer0: period error too high"); \
+	TCNT0 = 0; \
+	OCR0 = TIMER01_COMPARE(PERIOD_US,TIMER0_CS(PERIOD_US)); \
+	TCCR0 = (1<<FOC0) | (1<<WGM01) | TIMER0_CS(PERIOD_US); \
+	TIFR = (1<<OCF0); \
+	SET_BIT(TIMSK,OCIE0); \
+} while(0)
+
+/* Timer2 CTC mode interrupting every PERIOD_US, prescaler picked automatically */
+#define TIMER2_CTC_INIT(PERIOD_US) do { \
+	_Static_assert(TIMER2_CS(PERIOD_US) != 0, "Timer2: period too long"); \
+	_Static_assert(TIMER_ERROR_PPM(PERIOD_US,TIMER2_DIV(TIMER2_CS(PERIOD_US))) <= TIMER_MAX_ERROR_PPM, "Timer2: period error too high"); \
+	TCNT2 = 0; \
+	OCR2 = TIMER2_COMPARE(PERIOD_US,TIMER2_CS(PERIOD_US)); \
+	TCCR2 = (1<<FOC2) | (1<<WGM21) | TIMER2_CS(PERIOD_US); \
+	TIFR = (1<<OCF2); \
+	SET_BIT(TIMSK,OCIE2); \
+} while(0)
+
+/*
+ * Define the Timer0/Timer2 compare ISR calling HANDLER, to be used once at file scope in the module
+ * owning HANDLER (static there so it is inlined), which must include avr/interrupt.h.
+ */
+#define TIMER0_COMP_BIND(HANDLER)       ISR(TIMER0_COMP_vect) { HANDLER(); }
+#define TIMER2_COMP_BIND(HANDLER)       ISR(TIMER2_COMP_vect) { HANDLER(); }
+
+/*******************************************************************************
+ *                      Clock Interrupt Binding                                *
+ *******************************************************************************/
+/* Monotonic clock state, exposed only for the inline tick below */
+extern volatile uint32 g_Timer1Millis;
+extern volatile uint8 g_Timer1ClockStep;
+extern volatile boolean g_Timer1ClockRunning;
+
+#if (TIMER_MEASURE_ISR_CYCLES == 1)
+extern volatile uint16 g_Timer1IsrCycles;
+extern volatile uint16 g_Timer1IsrMaxCycles;
+
+/* TCNT1 restarted from 0 at the compare match so it holds the time spent since then */
+#define TIMER1_ISR_CYCLES_END() do { \
+	uint16 cycles = TCNT1 * (uint16)TIMER01_DIV(TIMER_CLOCK_CS); \
+	g_Timer1IsrCycles = cycles; \
+	if (cycles > g_Timer1IsrMaxCycles) { g_Timer1IsrMaxCycles = cycles; } \
+} while(0)
+#else
+#define TIMER1_ISR_CYCLES_END()
+#endif
+
+/*
+ * Description: Clock part of the Timer1 compare ISR, accounts the elapsed period.
+ *  Only for use inside that ISR.
  * */
-void Timer_init(const Timer_Config* TimerConfig);
+static inline void Timer_clockTick(void)
+{
+	if (g_Timer1ClockRunning)
+	{
+		g_Timer1Millis += g_Timer1ClockStep;
+		if (g_Timer1ClockStep != 1)
+		{
+			/* a stretched period is one-shot, go back to the 1 ms tick */
+			g_Timer1ClockStep = 1;
+			OCR1A = TIMER_CLOCK_COUNTS_PER_MS - 1;
+		}
+	}
+}
+
+/*
+ * Description: Milliseconds of the clock as seen from the Timer1 compare ISRs, after Timer_clockTick.
+ * */
+static inline uint32 Timer_getMillisFromIsr(void)
+{
+	return g_Timer1Millis;
+}
+
+#if (TIMER1_COMPA_BINDING == TIMER_BINDING_STATIC)
+/*
+ * Defines the Timer1 compare ISRs with the handlers bound at compile time, to be used once at file
+ * scope in the module owning them so they can be inlined (they should be static there).
+ * TICK runs on every tick and must make no call. It returns TRUE when there is more to do, which
+ * DEFERRED does in the compare B ISR: OCR1B is 0 so its flag is set at the start of every period
+ * and stays set while its interrupt is off, enabling it runs the ISR as soon as this one returns.
+ */
+#define TIMER1_COMPA_BIND_STATIC(TICK,DEFERRED) \
+ISR(TIMER1_COMPA_vect) \
+{ \
+	Timer_clockTick(); \
+	if (TICK()) \
+	{ \
+		SET_BIT(TIMSK,OCIE1B); \
+	} \
+	TIMER1_ISR_CYCLES_END(); \
+} \
+ISR(TIMER1_COMPB_vect) \
+{ \
+	CLEAR_BIT(TIMSK,OCIE1B); \
+	DEFERRED(); \
+	TIMER1_ISR_CYCLES_END(); \
+}
+#endif
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
 
+typedef enum{
+	Timer0, Timer1, Timer2
+}Timer_type;
 
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
 /*
  * Description: A function to disable a specific timer
  *  the function disables: the clock, overflow & CTC interrupts
- *  the function clears: initial value, compare value & the call-back function
+ *  the function clears: initial value & compare value (and the Timer1 clock call-back)
  * */
 void Timer_deinit(Timer_type type);
 
+/*
+ * Description: A function that starts the monotonic clock on Timer1 (1 ms compare interrupt).
+ *  the given call-back function (may be NULL_PTR) is called on every millisecond tick when
+ *  TIMER1_COMPA_BINDING is dynamic, with the static binding it is ignored in favour of the
+ *  handlers given to TIMER1_COMPA_BIND_STATIC.
+ * */
+void Timer_startClock(void (*tickCallBackPtr)(void));
+
+/*
+ * Description: A function that returns the milliseconds elapsed since Timer_startClock.
+ *  the 32-bit value is read atomically and wraps after about 49 days.
+ * */
+uint32 Timer_getMillis(void);
+
+/*
+ * Description: A function that returns the microseconds elapsed since Timer_startClock.
+ *  the 32-bit value is read atomically and wraps after about 71 minutes.
+ * */
+uint32 Timer_getMicros(void);
+
+/*
+ * Description: A function that delays the next clock interrupt to fire after period_ms milliseconds
+ *  (at most TIMER_CLOCK_MAX_STRETCH_MS) instead of every millisecond, used for tickless idle.
+ *  the clock keeps counting correctly and goes back to the 1 ms tick after that interrupt.
+ * */
+void Timer_stretchClock(uint8 period_ms);
+
+/*
+ * Description: A function that ends a stretched clock period early, on the next millisecond boundary,
+ *  used when the CPU is woken up by another interrupt.
+ * */
+void Timer_restoreClock(void);
+
+#if (TIMER_MEASURE_ISR_CYCLES == 1)
+/*
+ * Description: A function that returns the cycles taken by the last Timer1 compare ISR (up to the
+ *  end of the compare B ISR on a tick that fires timers), or the highest seen so far if max is TRUE.
+ * */
+uint16 Timer_getIsrCycles(boolean max);
+#endif
+
 #endif /* TIMER_H_ */
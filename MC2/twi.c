@@ -13,7 +13,116 @@
 #include "twi.h"
 
 #include "common_macros.h"
+#include "spsc_queue.h"
+#include "power.h" /* To wake up a waiting application */
+#include "sw_timer.h" /* To time the transactions out */
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h> /* For the bus clear clock */
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* Transactions waiting for the bus: queued by the application, taken by the engine */
+static uint8 g_queueBuffer[TWI_QUEUE_LENGTH * sizeof(TWI_Transaction *)];
+static SpscQueue g_queue = SPSC_QUEUE_INITIALIZER(g_queueBuffer);
+
+/* Transaction on the bus, NULL_PTR when the engine is idle */
+static TWI_Transaction *volatile g_current = NULL_PTR;
+static volatile uint8 g_index = 0; /* next byte to write or read in the current transaction */
+
+static SwTimer g_timeoutTimer; /* runs while a transaction is on the bus */
+static volatile TWI_ErrorCounters g_errors = {0, 0, 0, 0};
+
+/*******************************************************************************
+ *                      Private Functions Prototypes                           *
+ *******************************************************************************/
+static void TWI_startNext(void);
+static void TWI_finish(TWI_TransactionStatus status);
+static void TWI_timeout(void);
+
+/*******************************************************************************
+ *                        Interrupt Service Routines                           *
+ *******************************************************************************/
+/*
+ * Transaction engine, one step per bus event:
+ * START -> SLA+W -> data... -> [REPEATED START -> SLA+R -> data...] -> STOP
+ */
+ISR(TWI_vect)
+{
+	TWI_Transaction *transaction = g_current;
+	uint8 status = TWSR & 0xF8;
+
+	switch(status)
+	{
+	case TWI_START:
+	case TWI_REP_START:
+		/* write first if there is anything to write (or nothing at all to read) */
+		g_index = 0;
+		if((status == TWI_START) && ((transaction->writeLength != 0) || (transaction->readLength == 0)))
+		{
+			TWDR = (uint8)(transaction->slaveAddress << 1);
+		}
+		else
+		{
+			TWDR = (uint8)((transaction->slaveAddress << 1) | 1);
+		}
+		TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+		break;
+
+	case TWI_MT_SLA_W_ACK:
+	case TWI_MT_DATA_ACK:
+		if(g_index < transaction->writeLength)
+		{
+			TWDR = transaction->writeData[g_index++];
+			TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+		}
+		else if(transaction->readLength != 0)
+		{
+			TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+		}
+		else
+		{
+			TWI_finish(TWI_TRANSACTION_DONE);
+		}
+		break;
+
+	case TWI_MR_DATA_ACK:
+		transaction->readData[g_index++] = TWDR;
+		/* fall through */
+	case TWI_MT_SLA_R_ACK:
+		/* acknowledge every byte but the last one */
+		if((uint8)(g_index + 1) < transaction->readLength)
+		{
+			TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE) | (1 << TWEA);
+		}
+		else
+		{
+			TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+		}
+		break;
+
+	case TWI_MR_DATA_NACK:
+		transaction->readData[g_index] = TWDR;
+		TWI_finish(TWI_TRANSACTION_DONE);
+		break;
+
+	default:
+		/* no acknowledge from the slave, arbitration lost or bus error, the stop releases the bus */
+		if(status == TWI_BUS_ERROR)
+		{
+			g_errors.busErrors++;
+		}
+		else if(status == TWI_ARB_LOST)
+		{
+			g_errors.arbitrationLost++;
+		}
+		transaction->errorStatus = status;
+		TWI_finish(TWI_TRANSACTION_FAILED);
+		break;
+	}
+}
 
 void TWI_init(const TWI_Configurations * config)
 {
@@ -27,73 +136,137 @@ void TWI_init(const TWI_Configurations * config)
     TWCR = (1<<TWEN); /* enable TWI */
 }
 
-void TWI_start(void)
+void TWI_busClear(void)
 {
-    /* 
-	 * Clear the TWINT flag before sending the start bit TWINT=1
-	 * send the start bit by TWSTA=1
-	 * Enable TWI Module TWEN=1 
-	 */
-    TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN);
-    
-    /* Wait for TWINT flag set in TWCR Register (start bit is send successfully) */
-    while(BIT_IS_CLEAR(TWCR,TWINT));
+	uint8 pulse;
+
+	/* with the module off the pins are back to the port, released high by the pull-ups */
+	TWCR = 0;
+	CLEAR_BIT(TWI_PORT,TWI_SCL);
+	CLEAR_BIT(TWI_PORT,TWI_SDA);
+	CLEAR_BIT(TWI_DDR,TWI_SCL);
+	CLEAR_BIT(TWI_DDR,TWI_SDA);
+	_delay_us(TWI_BUS_CLEAR_HALF_PERIOD_US);
+
+	/* a slave stuck in the middle of a byte lets SDA go after at most nine clocks */
+	for(pulse = 0; (pulse < 9) && BIT_IS_CLEAR(TWI_PIN,TWI_SDA); pulse++)
+	{
+		SET_BIT(TWI_DDR,TWI_SCL); /* drive SCL low */
+		_delay_us(TWI_BUS_CLEAR_HALF_PERIOD_US);
+		CLEAR_BIT(TWI_DDR,TWI_SCL); /* release SCL high */
+		_delay_us(TWI_BUS_CLEAR_HALF_PERIOD_US);
+	}
+
+	/* START then STOP: SDA low then high while SCL is high, every slave goes back to idle */
+	SET_BIT(TWI_DDR,TWI_SDA);
+	_delay_us(TWI_BUS_CLEAR_HALF_PERIOD_US);
+	CLEAR_BIT(TWI_DDR,TWI_SDA);
+	_delay_us(TWI_BUS_CLEAR_HALF_PERIOD_US);
+
+	TWCR = (1 << TWEN);
+	g_errors.busClears++;
 }
 
-void TWI_stop(void)
+void TWI_getErrorCounters(TWI_ErrorCounters *counters)
 {
-    /* 
-	 * Clear the TWINT flag before sending the stop bit TWINT=1
-	 * send the stop bit by TWSTO=1
-	 * Enable TWI Module TWEN=1 
-	 */
-    TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWEN);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		counters->busErrors = g_errors.busErrors;
+		counters->arbitrationLost = g_errors.arbitrationLost;
+		counters->timeouts = g_errors.timeouts;
+		counters->busClears = g_errors.busClears;
+	}
 }
 
-void TWI_writeByte(uint8 data)
+boolean TWI_submit(TWI_Transaction *transaction)
 {
-    /* Put data On TWI data Register */
-    TWDR = data;
-    /* 
-	 * Clear the TWINT flag before sending the data TWINT=1
-	 * Enable TWI Module TWEN=1 
-	 */ 
-    TWCR = (1 << TWINT) | (1 << TWEN);
-    /* Wait for TWINT flag set in TWCR Register(data is send successfully) */
-    while(BIT_IS_CLEAR(TWCR,TWINT));
+	transaction->status = TWI_TRANSACTION_QUEUED;
+	if(!SpscQueue_write(&g_queue, (const uint8 *)&transaction, sizeof(transaction)))
+	{
+		transaction->status = TWI_TRANSACTION_IDLE;
+		return FALSE;
+	}
+
+	/* the engine takes the next transaction itself when it finishes one, start it if it is idle */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(g_current == NULL_PTR)
+		{
+			TWI_startNext();
+		}
+	}
+	return TRUE;
 }
 
-uint8 TWI_readByteWithACK(void)
+boolean TWI_isBusy(void)
 {
-	/* 
-	 * Clear the TWINT flag before reading the data TWINT=1
-	 * Enable sending ACK after reading or receiving data TWEA=1
-	 * Enable TWI Module TWEN=1 
-	 */ 
-    TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWEA);
-    /* Wait for TWINT flag set in TWCR Register (data received successfully) */
-    while(BIT_IS_CLEAR(TWCR,TWINT));
-    /* Read Data */
-    return TWDR;
+	return (g_current != NULL_PTR) || !SpscQueue_isEmpty(&g_queue);
 }
 
-uint8 TWI_readByteWithNACK(void)
+/*
+ * Description :
+ * Take the next queued transaction and send its start condition, called with the interrupts disabled.
+ */
+static void TWI_startNext(void)
 {
-	/* 
-	 * Clear the TWINT flag before reading the data TWINT=1
-	 * Enable TWI Module TWEN=1 
-	 */
-    TWCR = (1 << TWINT) | (1 << TWEN);
-    /* Wait for TWINT flag set in TWCR Register (data received successfully) */
-    while(BIT_IS_CLEAR(TWCR,TWINT));
-    /* Read Data */
-    return TWDR;
+	TWI_Transaction *transaction;
+
+	if(SpscQueue_read(&g_queue, (uint8 *)&transaction, sizeof(transaction)))
+	{
+		uint16 spin = 0;
+
+		g_current = transaction;
+		transaction->status = TWI_TRANSACTION_BUSY;
+		/* a stop condition of the previous transaction may still be on its way, unless a slave holds SCL */
+		while(BIT_IS_SET(TWCR,TWSTO))
+		{
+			if(++spin == TWI_STOP_SPIN_LIMIT)
+			{
+				TWI_busClear();
+				break;
+			}
+		}
+		SwTimer_start(&g_timeoutTimer, TWI_TRANSACTION_TIMEOUT_MS, SW_TIMER_ONE_SHOT, TWI_timeout);
+		TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+	}
+	else
+	{
+		g_current = NULL_PTR;
+	}
+}
+
+/*
+ * Description :
+ * Release the bus, report the end of the current transaction and go on with the next one.
+ */
+static void TWI_finish(TWI_TransactionStatus status)
+{
+	TWI_Transaction *transaction = g_current;
+
+	SwTimer_cancel(&g_timeoutTimer);
+	TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWEN);
+	transaction->status = status;
+	if(transaction->callBackPtr != NULL_PTR)
+	{
+		transaction->callBackPtr(transaction);
+	}
+	Power_signalEvent();
+	TWI_startNext();
 }
 
-uint8 TWI_getStatus(void)
+/*
+ * Description :
+ * Timeout timer call-back (Timer1 interrupt): the current transaction got stuck, most likely on a
+ * slave holding SDA low or a missed interrupt. Clear the bus and fail the transaction.
+ */
+static void TWI_timeout(void)
 {
-    uint8 status;
-    /* masking to eliminate first 3 bits and get the last 5 bits (status bits) */
-    status = TWSR & 0xF8;
-    return status;
+	if(g_current == NULL_PTR)
+	{
+		return;
+	}
+	g_errors.timeouts++;
+	g_current->errorStatus = TWI_TIMEOUT;
+	TWI_busClear();
+	TWI_finish(TWI_TRANSACTION_FAILED);
 }
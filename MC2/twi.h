@@ -23,6 +23,37 @@ typedef struct{
 	uint8 slaveAddress; /* it should be 7 bits [otherwise, LS 7 bits are used] */
 }TWI_Configurations;
 
+typedef enum{
+	TWI_TRANSACTION_IDLE, TWI_TRANSACTION_QUEUED, TWI_TRANSACTION_BUSY, TWI_TRANSACTION_DONE, TWI_TRANSACTION_FAILED
+}TWI_TransactionStatus;
+
+/*
+ * A transaction sends writeLength bytes to the slave then, after a repeated start, reads
+ * readLength bytes from it. Either part may be empty: a write, a read or a write-then-read
+ * (like setting the memory address of an EEPROM then reading from it).
+ * The structure and the buffers belong to the engine from TWI_submit till the status is
+ * DONE or FAILED, so they must not be on the stack of a function returning meanwhile.
+ */
+typedef struct TWI_Transaction{
+	uint8 slaveAddress;                 /* 7-bit address of the slave */
+	const uint8 *writeData;
+	uint8 writeLength;
+	uint8 *readData;
+	uint8 readLength;
+	volatile TWI_TransactionStatus status;
+	volatile uint8 errorStatus;         /* TWSR status that ended a failed transaction */
+	/* called from the TWI interrupt once the transaction is DONE or FAILED, may be NULL_PTR */
+	void (*callBackPtr)(struct TWI_Transaction *transaction);
+}TWI_Transaction;
+
+/* Bus faults seen since power-on. A NACK is not counted, EEPROM acknowledge polling makes them on purpose */
+typedef struct{
+	uint16 busErrors;        /* illegal START or STOP seen on the bus */
+	uint16 arbitrationLost;
+	uint16 timeouts;         /* transactions that did not complete in time */
+	uint16 busClears;
+}TWI_ErrorCounters;
+
 /*******************************************************************************
  *                      Preprocessor Macros                                    *
  *******************************************************************************/
@@ -35,17 +66,59 @@ typedef struct{
 #define TWI_MT_DATA_ACK   0x28 /* Master transmit data and ACK has been received from Slave. */
 #define TWI_MR_DATA_ACK   0x50 /* Master received data and send ACK to slave. */
 #define TWI_MR_DATA_NACK  0x58 /* Master received data but doesn't send ACK to slave. */
+#define TWI_BUS_ERROR     0x00 /* illegal START or STOP condition */
+#define TWI_ARB_LOST      0x38 /* arbitration lost */
+#define TWI_TIMEOUT       0x01 /* not a TWSR status (its low bits are masked): the transaction did not complete in time */
+
+/* The TWI pins, driven by hand to clear the bus */
+#define TWI_PORT          PORTC
+#define TWI_DDR           DDRC
+#define TWI_PIN           PINC
+#define TWI_SCL           0   /* PC0 */
+#define TWI_SDA           1   /* PC1 */
+#define TWI_BUS_CLEAR_HALF_PERIOD_US  5 /* 100kHz, the slowest a slave has to take */
+
+/* Longest a transaction may take, far above 17 bytes at the 400kHz bit rate */
+#define TWI_TRANSACTION_TIMEOUT_MS    10
+/* Turns of the wait for a STOP to go out before the bus is taken as held, about 0.5ms */
+#define TWI_STOP_SPIN_LIMIT           1000
+
+/* Transactions waiting for the bus, a power of two */
+#define TWI_QUEUE_LENGTH  8
 
 /*******************************************************************************
  *                      Functions Prototypes                                   *
  *******************************************************************************/
 void TWI_init(const TWI_Configurations * config);
-void TWI_start(void);
-void TWI_stop(void);
-void TWI_writeByte(uint8 data);
-uint8 TWI_readByteWithACK(void);
-uint8 TWI_readByteWithNACK(void);
-uint8 TWI_getStatus(void);
+
+/*
+ * Description :
+ * Free a bus held by a slave: with the TWI module off, clock SCL up to nine times till the
+ * slave releases SDA, then send a STOP and turn the module back on.
+ * Called by the driver after a timeout, do not call it while a transaction is in progress.
+ */
+void TWI_busClear(void);
+
+/*
+ * Description :
+ * Copy the bus fault counters.
+ */
+void TWI_getErrorCounters(TWI_ErrorCounters *counters);
+
+/*
+ * Description :
+ * Queue a transaction and return at once, the TWI interrupt runs it when the bus is free.
+ * Return FALSE if the queue is full.
+ * A transaction still running after TWI_TRANSACTION_TIMEOUT_MS is FAILED with the errorStatus
+ * TWI_TIMEOUT and the bus is cleared.
+ */
+boolean TWI_submit(TWI_Transaction *transaction);
+
+/*
+ * Description :
+ * Return TRUE while a transaction is queued or in progress.
+ */
+boolean TWI_isBusy(void);
 
 
 #endif /* TWI_H_ */
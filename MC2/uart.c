@@ -13,6 +13,150 @@
 #include "uart.h"
 #include "avr/io.h" /* To use the UART Registers */
 #include "common_macros.h" /* To use the macros like SET_BIT */
+#include "avr/interrupt.h" /* For UART ISR */
+#include "util/atomic.h" /* For ATOMIC_BLOCK */
+#include "gpio.h"
+#include "power.h" /* To wake up a waiting application */
+#include "sw_timer.h" /* To end the break */
+#include "spsc_queue.h"
+
+#if !SPSC_QUEUE_SIZE_IS_VALID(UART_RX_BUFFER_SIZE)
+#error "UART_RX_BUFFER_SIZE must be a power of two not greater than 128"
+#endif
+
+#if !SPSC_QUEUE_SIZE_IS_VALID(UART_TX_BUFFER_SIZE)
+#error "UART_TX_BUFFER_SIZE must be a power of two not greater than 128"
+#endif
+
+#if (UART_BAUD_ERROR_PERMILLE(UART_BAUD_RATE) > UART_MAX_BAUD_ERROR_PERMILLE)
+#error "UART_BAUD_RATE can not be generated accurately from F_CPU"
+#endif
+
+/* Every negotiable rate must be accurate enough, negotiation must never be able to pick a bad one */
+#define UART_BAUD_CHECK(BAUD)   _Static_assert(UART_BAUD_ERROR_PERMILLE(BAUD) <= UART_MAX_BAUD_ERROR_PERMILLE, \
+		"baud rate " #BAUD " can not be generated accurately from F_CPU");
+UART_BAUD_TABLE(UART_BAUD_CHECK)
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* Receive queue: filled by the RX ISR, emptied by the application */
+static uint8 g_rxBuffer[UART_RX_BUFFER_SIZE];
+static SpscQueue g_rxQueue = SPSC_QUEUE_INITIALIZER(g_rxBuffer);
+
+/* Transmit queue: filled by the application, emptied by the UDRE ISR */
+static uint8 g_txBuffer[UART_TX_BUFFER_SIZE];
+static SpscQueue g_txQueue = SPSC_QUEUE_INITIALIZER(g_txBuffer);
+static volatile boolean g_txComplete = TRUE;
+
+/* Global variable to hold the address of the TX complete call back function in the application */
+static void (*volatile g_txCompleteCallBackPtr)(void) = NULL_PTR;
+
+static volatile boolean g_breakDetected = FALSE;
+
+/* A break is being sent, the bytes queued meanwhile wait for its end */
+static volatile boolean g_breakActive = FALSE;
+static SwTimer g_breakTimer;
+
+/* Baud rate table generated at compile time from UART_BAUD_TABLE */
+#define UART_BAUD_ENTRY(BAUD)   {BAUD, UART_UBRR_VALUE(BAUD), UART_BAUD_ERROR_PERMILLE(BAUD)},
+static const UART_baudEntry g_baudTable[] = { UART_BAUD_TABLE(UART_BAUD_ENTRY) };
+#define UART_BAUD_COUNT         (sizeof(g_baudTable) / sizeof(g_baudTable[0]))
+
+static uint8 g_baudIndex = UART_SAFE_BAUD_INDEX;
+/* Baud rate index to switch to once the transmitter is idle, UART_NO_BAUD_INDEX for none */
+#define UART_NO_BAUD_INDEX      0xFF
+static volatile uint8 g_nextBaudIndex = UART_NO_BAUD_INDEX;
+
+/* Link health counters, updated from the UART ISRs */
+static volatile UART_Stats g_stats;
+/* Value of bytesIn + bytesOut at the last throughput update */
+static uint32 g_lastByteCount = 0;
+
+/*******************************************************************************
+ *                      Private Functions Prototypes                           *
+ *******************************************************************************/
+static void UART_applyBaudIndex(uint8 index);
+static void UART_txDone(void);
+static void UART_endBreak(void);
+
+/*******************************************************************************
+ *                        Interrupt Service Routines                           *
+ *******************************************************************************/
+ISR(USART_RXC_vect)
+{
+	/* The error flags belong to the byte in UDR so UCSRA must be read first */
+	uint8 status = UCSRA;
+	/* Reading UDR clears the RXC flag */
+	uint8 data = UDR;
+
+	/* A zero byte without a stop bit is a break sent by the other ECU */
+	if(BIT_IS_SET(status,FE) && (data == 0))
+	{
+		g_breakDetected = TRUE;
+		Power_signalEvent();
+		return;
+	}
+
+	/* Overrun means an earlier byte was lost, the one in UDR is still good */
+	if(BIT_IS_SET(status,DOR))
+	{
+		g_stats.overrunErrors++;
+	}
+
+	/* Bytes with a framing or parity error are known to be corrupted */
+	if(BIT_IS_SET(status,FE))
+	{
+		g_stats.framingErrors++;
+		return;
+	}
+	if(BIT_IS_SET(status,PE))
+	{
+		g_stats.parityErrors++;
+		return;
+	}
+
+	/* Drop the byte if the application did not keep up and the buffer is full */
+	if(SpscQueue_push(&g_rxQueue, data))
+	{
+		g_stats.bytesIn++;
+		Power_signalEvent();
+	}
+	else
+	{
+		g_stats.rxDropped++;
+	}
+}
+
+ISR(USART_UDRE_vect)
+{
+	uint8 data;
+
+	if(SpscQueue_pop(&g_txQueue, &data))
+	{
+		/* Writing UDR clears the UDRE flag until the byte moves to the shift register */
+		UDR = data;
+		g_stats.bytesOut++;
+	}
+	else
+	{
+		/* Queue drained: stop the UDRE interrupt and wait for the last byte to be shifted out */
+		CLEAR_BIT(UCSRB,UDRIE);
+		SET_BIT(UCSRA,TXC); /* Clear a stale TXC flag by writing one to it */
+		SET_BIT(UCSRB,TXCIE);
+	}
+}
+
+ISR(USART_TXC_vect)
+{
+	CLEAR_BIT(UCSRB,TXCIE);
+
+	/* Another byte may have been queued between the UDRE and the TXC interrupts */
+	if(SpscQueue_isEmpty(&g_txQueue))
+	{
+		UART_txDone();
+	}
+}
 
 /*******************************************************************************
  *                      Functions Definitions                                  *
@@ -23,86 +167,149 @@
  * Functional responsible for Initialize the UART device by:
  * 1. Setup the Frame format like number of data bits, parity bit type and number of stop bits.
  * 2. Enable the UART.
- * 3. Setup the UART baud rate.
+ * 3. Setup the UART baud rate from its entry in the baud rate table, a rate missing from the
+ *    table is replaced by the safe one so UART_getBaudIndex always tells the rate in use.
  */
 void UART_init(uint32 baud_rate,UART_configType *Config_ptr)
 {
-	uint16 ubrr_value = 0;
+	uint8 index;
 
 	/* U2X = 1 for double transmission speed */
 	UCSRA = (1<<U2X);
 
 	/************************** UCSRB Description **************************
-	 * RXCIE = 0 Disable USART RX Complete Interrupt Enable
+	 * RXCIE = 1 Enable USART RX Complete Interrupt Enable
 	 * TXCIE = 0 Disable USART Tx Complete Interrupt Enable
-	 * UDRIE = 0 Disable USART Data Register Empty Interrupt Enable
+	 * UDRIE = 0 USART Data Register Empty Interrupt is enabled only while bytes are queued
 	 * RXEN  = 1 Receiver Enable
 	 * RXEN  = 1 Transmitter Enable
 	 * UCSZ2 = 0 For 8-bit data mode
 	 * RXB8 & TXB8 not used for 8-bit data mode
 	 ***********************************************************************/ 
-	UCSRB = (1<<RXEN) | (1<<TXEN);
+	UCSRB = (1<<RXCIE) | (1<<RXEN) | (1<<TXEN);
 	
 	/************************** UCSRC Description **************************
 	 * URSEL   = 1 The URSEL must be one when writing the UCSRC
 	 * UMSEL   = 0 Asynchronous Operation
-	 * UPM1:0  = 00 Disable parity bit
-	 * USBS    = 0 One stop bit
-	 * UCSZ1:0 = 11 For 8-bit data mode
+	 * UPM1:0  = parity bit mode from the configuration
+	 * USBS    = number of stop bits from the configuration
+	 * UCSZ1:0 = character size from the configuration
 	 * UCPOL   = 0 Used with the Synchronous operation only
 	 ***********************************************************************/
-	UCSRC = (UCSRC & 0xCF) | ((Config_ptr -> parity)<<4);
-	UCSRC = (UCSRC & 0xF9) | ((Config_ptr -> size)<<1);
-	UCSRC = (UCSRC & 0xF7) | ((Config_ptr -> stop)<<3);
- 	UCSRC = (1<<URSEL) | (1<<UCSZ0) | (1<<UCSZ1);
+	UCSRC = (1<<URSEL) | ((Config_ptr -> parity)<<UPM0) | ((Config_ptr -> stop)<<USBS) | ((Config_ptr -> size)<<UCSZ0);
 	
-	/* Calculate the UBRR register value */
-	ubrr_value = (uint16)(((F_CPU / (baud_rate * 8UL))) - 1);
+	/* The UBRR value comes from the baud rate table so the hardware and g_baudIndex always agree */
+	g_baudIndex = UART_SAFE_BAUD_INDEX;
+	for(index = 0; index < UART_BAUD_COUNT; index++)
+	{
+		if(g_baudTable[index].baudRate == baud_rate)
+		{
+			g_baudIndex = index;
+			break;
+		}
+	}
 
 	/* First 8 bits from the BAUD_PRESCALE inside UBRRL and last 4 bits in UBRRH*/
-	UBRRH = ubrr_value>>8;
-	UBRRL = ubrr_value;
+	UBRRH = g_baudTable[g_baudIndex].ubrr>>8;
+	UBRRL = g_baudTable[g_baudIndex].ubrr;
 }
 
 /*
  * Description :
  * Functional responsible for send byte to another UART device.
+ * The byte is queued and sent in the background, blocks only while the transmit queue is full.
  */
 void UART_sendByte(const uint8 data)
 {
-	/*
-	 * UDRE flag is set when the Tx buffer (UDR) is empty and ready for
-	 * transmitting a new byte so wait until this flag is set to one
-	 */
-	while(BIT_IS_CLEAR(UCSRA,UDRE)){}
+	/* Wait until the UDRE ISR makes room in the queue */
+	while(!UART_sendBuffer(&data,1)){}
+}
 
-	/*
-	 * Put the required data in the UDR register and it also clear the UDRE flag as
-	 * the UDR register is not empty now
-	 */
-	UDR = data;
+/*
+ * Description :
+ * Queue len bytes for transmission and return immediately.
+ * Return FALSE without queuing anything if the transmit queue has no room for the whole buffer.
+ */
+boolean UART_sendBuffer(const uint8 *data, uint8 len)
+{
+	if(!SpscQueue_write(&g_txQueue, data, len))
+	{
+		return FALSE;
+	}
 
-	/************************* Another Method *************************
-	UDR = data;
-	while(BIT_IS_CLEAR(UCSRA,TXC)){} // Wait until the transmission is complete TXC = 1
-	SET_BIT(UCSRA,TXC); // Clear the TXC flag
-	*******************************************************************/
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		/* Let the UDRE ISR start draining the queue, at the end of the break if one is being sent */
+		g_txComplete = FALSE;
+		if(!g_breakActive)
+		{
+			CLEAR_BIT(UCSRB,TXCIE);
+			SET_BIT(UCSRB,UDRIE);
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Description :
+ * Return TRUE when the transmit queue is empty, the last byte has left the shift register
+ * and no break is being sent.
+ */
+boolean UART_isTxComplete(void)
+{
+	return g_txComplete;
+}
+
+/*
+ * Description :
+ * Wait until every queued byte has been transmitted.
+ */
+void UART_flush(void)
+{
+	while(!g_txComplete){}
+}
+
+/*
+ * Description :
+ * Set the function called (from interrupt context) once the transmit queue has been completely sent.
+ */
+void UART_setTxCompleteCallBack(void (*a_ptr)(void))
+{
+	g_txCompleteCallBackPtr = a_ptr;
 }
 
 /*
  * Description :
  * Functional responsible for receive byte from another UART device.
+ * Blocks until a byte is available in the receive buffer.
  */
 uint8 UART_recieveByte(void)
 {
-	/* RXC flag is set when the UART receive data so wait until this flag is set to one */
-	while(BIT_IS_CLEAR(UCSRA,RXC)){}
+	uint8 data;
+
+	/* The RX ISR fills the buffer so wait until it holds at least one byte */
+	while(!UART_tryReceiveByte(&data)){}
 
-	/*
-	 * Read the received data from the Rx buffer (UDR)
-	 * The RXC flag will be cleared after read the data
-	 */
-    return UDR;		
+	return data;
+}
+
+/*
+ * Description :
+ * Return the number of received bytes waiting in the receive buffer.
+ */
+uint8 UART_available(void)
+{
+	return SpscQueue_count(&g_rxQueue);
+}
+
+/*
+ * Description :
+ * Take one byte from the receive buffer without blocking.
+ * Return TRUE and store the byte in data if one was available, otherwise return FALSE.
+ */
+boolean UART_tryReceiveByte(uint8 *data)
+{
+	return SpscQueue_pop(&g_rxQueue, data);
 }
 
 /*
@@ -149,3 +356,213 @@ void UART_receiveString(uint8 *Str)
 	/* After receiving the whole string plus the '#', replace the '#' with '\0' */
 	Str[i] = '\0';
 }
+
+/*
+ * Description :
+ * Return the number of entries in the baud rate table.
+ */
+uint8 UART_getBaudCount(void)
+{
+	return UART_BAUD_COUNT;
+}
+
+/*
+ * Description :
+ * Return the baud rate table entry of the given index.
+ */
+const UART_baudEntry * UART_getBaudEntry(uint8 index)
+{
+	if(index >= UART_BAUD_COUNT)
+	{
+		return NULL_PTR;
+	}
+	return &g_baudTable[index];
+}
+
+/*
+ * Description :
+ * Return TRUE if the baud rate of the given index exists and is within UART_MAX_BAUD_ERROR_PERMILLE.
+ */
+boolean UART_isBaudUsable(uint8 index)
+{
+	return (index < UART_BAUD_COUNT) && (g_baudTable[index].errorPermille <= UART_MAX_BAUD_ERROR_PERMILLE);
+}
+
+/*
+ * Description :
+ * Switch to the baud rate of the given table index once the queued bytes are sent: at once if
+ * the transmitter is idle, else from the interrupt that sees the last one out.
+ */
+void UART_setBaudIndex(uint8 index)
+{
+	if(!UART_isBaudUsable(index))
+	{
+		return;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		/* Changing UBRR while a byte is shifted out would corrupt it */
+		if(g_txComplete)
+		{
+			UART_applyBaudIndex(index);
+		}
+		else
+		{
+			g_nextBaudIndex = index;
+		}
+	}
+}
+
+/*
+ * Description :
+ * Return the table index of the baud rate in use.
+ */
+uint8 UART_getBaudIndex(void)
+{
+	return g_baudIndex;
+}
+
+/*
+ * Description :
+ * Pull the TX line low and return, a software timer releases it after UART_BREAK_DURATION_MS,
+ * which the receiver sees as a break at any baud rate. The bytes queued meanwhile are sent
+ * after the break. Return FALSE without sending it if the transmitter is not idle.
+ */
+boolean UART_sendBreak(void)
+{
+	boolean idle;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		idle = g_txComplete;
+		if(idle)
+		{
+			g_txComplete = FALSE;
+			g_breakActive = TRUE;
+			/* Disabling the transmitter gives the TXD pin (PD1) back to the GPIO port */
+			GPIO_setupPinDirection(PORTD_ID, PIN1_ID, PIN_OUTPUT);
+			GPIO_writePin(PORTD_ID, PIN1_ID, LOGIC_LOW);
+			CLEAR_BIT(UCSRB,TXEN);
+		}
+	}
+	if(idle)
+	{
+		/* The first tick may come at once, one more holds the line low for the whole duration */
+		SwTimer_start(&g_breakTimer, UART_BREAK_DURATION_MS + SW_TIMER_TICK_MS, SW_TIMER_ONE_SHOT, UART_endBreak);
+	}
+	return idle;
+}
+
+/*
+ * Description :
+ * Return TRUE if a break was received since the last call, and clear the indication.
+ */
+boolean UART_breakDetected(void)
+{
+	boolean detected = g_breakDetected;
+
+	if(detected)
+	{
+		g_breakDetected = FALSE;
+	}
+	return detected;
+}
+
+/*
+ * Description :
+ * Take a consistent copy of the link health counters.
+ */
+void UART_getStats(UART_Stats *stats)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*stats = *(const UART_Stats *)&g_stats;
+	}
+}
+
+/*
+ * Description :
+ * Clear all the link health counters.
+ */
+void UART_resetStats(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		g_stats.framingErrors = 0;
+		g_stats.overrunErrors = 0;
+		g_stats.parityErrors = 0;
+		g_stats.rxDropped = 0;
+		g_stats.bytesIn = 0;
+		g_stats.bytesOut = 0;
+		g_stats.bytesPerSecond = 0;
+		g_lastByteCount = 0;
+	}
+}
+
+/*
+ * Description :
+ * Update the rolling throughput figure, must be called once every second (e.g. from the 1 second timer call back).
+ */
+void UART_updateThroughput(void)
+{
+	uint32 count;
+	uint16 rate;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		count = g_stats.bytesIn + g_stats.bytesOut;
+		rate = g_stats.bytesPerSecond;
+		/* Exponential moving average over about 4 seconds: rate += (new - rate) / 4 */
+		g_stats.bytesPerSecond = (uint16)((3UL * rate + (count - g_lastByteCount)) / 4);
+		g_lastByteCount = count;
+	}
+}
+
+/*
+ * Description :
+ * Program the baud rate of the given table index, the transmitter must be idle.
+ */
+static void UART_applyBaudIndex(uint8 index)
+{
+	UBRRH = g_baudTable[index].ubrr>>8;
+	UBRRL = g_baudTable[index].ubrr;
+	g_baudIndex = index;
+	g_nextBaudIndex = UART_NO_BAUD_INDEX;
+}
+
+/*
+ * Description :
+ * The transmitter went idle, called from interrupt context: make the baud rate switch that
+ * waited for it and tell the application.
+ */
+static void UART_txDone(void)
+{
+	if(g_nextBaudIndex != UART_NO_BAUD_INDEX)
+	{
+		UART_applyBaudIndex(g_nextBaudIndex);
+	}
+	g_txComplete = TRUE;
+	if(g_txCompleteCallBackPtr != NULL_PTR)
+	{
+		(*g_txCompleteCallBackPtr)();
+	}
+}
+
+/*
+ * Description :
+ * Break timer call back (Timer1 interrupt): release the TX line and send what was queued meanwhile.
+ */
+static void UART_endBreak(void)
+{
+	SET_BIT(UCSRB,TXEN);
+	g_breakActive = FALSE;
+	if(SpscQueue_isEmpty(&g_txQueue))
+	{
+		UART_txDone();
+	}
+	else
+	{
+		SET_BIT(UCSRB,UDRIE);
+	}
+}
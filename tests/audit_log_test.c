@@ -0,0 +1,284 @@
+ /******************************************************************************
+ *
+ * Module: AUDIT_LOG test
+ *
+ * File Name: audit_log_test.c
+ *
+ * Description: Host test of the MC2 audit log over a fake 24C16: the binary search of
+ *              AuditLog_init lap after lap, round the sequence number wrap, and entries cut
+ *              by a reset, on slot 0 where a new lap starts in particular
+ *
+ * Build and run on a PC (the log source is included to reach its head, count and sequence):
+ * 	gcc -O2 -std=gnu99 -I../MC2 audit_log_test.c ../MC2/crc.c -o audit_log_test
+ * 	./audit_log_test
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+/* The log only takes the time from the timer driver, which needs the AVR registers */
+#define TIMER_H_
+#include "std_types.h"
+uint32 Timer_getMillis(void);
+
+#include "audit_log.c"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+#define TEST_EEPROM_SIZE        2048        /* 24C16 */
+#define TEST_FRAME_TYPE         0x0D
+#define TEST_LAPS               5
+/* Reads of one init: slot 0, the binary search over 128 slots and the last slot */
+#define TEST_MAX_INIT_READS     9
+
+#define CHECK(CONDITION) do { if(!(CONDITION)) { printf("line %d: %s\n", __LINE__, #CONDITION); g_errors++; } } while(0)
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+static uint8 g_eeprom[TEST_EEPROM_SIZE];
+static unsigned g_reads;
+static uint32 g_millis = 1000;
+
+/* Bytes of the next entry write that reach the EEPROM before the power goes, 0 for no cut */
+static uint8 g_cutBytes = 0;
+
+/* Entries exported, and the frame that ended the export */
+static uint8 g_exported[AUDIT_LOG_ENTRIES * AUDIT_LOG_ENTRY_SIZE];
+static unsigned g_exportedLength;
+static boolean g_exportEnded;
+
+static unsigned long g_errors;
+
+/*******************************************************************************
+ *                      Fakes                                                  *
+ *******************************************************************************/
+uint32 Timer_getMillis(void)
+{
+	return g_millis++;
+}
+
+uint8 EEPROM_readBuffer(uint16 u16addr, uint8 *data, uint16 length)
+{
+	CHECK((u16addr >= AUDIT_LOG_START_ADDRESS) && (u16addr + length <= TEST_EEPROM_SIZE));
+	memcpy(data, g_eeprom + u16addr, length);
+	g_reads++;
+	return SUCCESS;
+}
+
+/* The cache keeps the order of the writes, written at once the log sees the same EEPROM */
+uint8 EEPROM_writeBehind(uint16 u16addr, const uint8 *data, uint16 length)
+{
+	CHECK((u16addr >= AUDIT_LOG_START_ADDRESS) && (length == AUDIT_LOG_ENTRY_SIZE));
+	CHECK((u16addr % EEPROM_PAGE_SIZE) + length <= EEPROM_PAGE_SIZE);
+	if(g_cutBytes != 0)
+	{
+		memcpy(g_eeprom + u16addr, data, g_cutBytes);
+		g_cutBytes = 0;
+		return ERROR;
+	}
+	memcpy(g_eeprom + u16addr, data, length);
+	return SUCCESS;
+}
+
+void PROTOCOL_sendFrame(uint8 type, const uint8 *payload, uint8 length)
+{
+	CHECK((type == TEST_FRAME_TYPE) && (length <= PROTOCOL_MAX_PAYLOAD) && ((length % AUDIT_LOG_ENTRY_SIZE) == 0));
+	CHECK(!g_exportEnded);
+	if(length == 0)
+	{
+		g_exportEnded = TRUE;
+		return;
+	}
+	memcpy(g_exported + g_exportedLength, payload, length);
+	g_exportedLength += length;
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+static void format(uint8 fill)
+{
+	memset(g_eeprom, fill, sizeof(g_eeprom));
+	AuditLog_init();
+}
+
+/*
+ * Description: Reboot and check AuditLog_init finds the log where the running one had it,
+ * 	within TEST_MAX_INIT_READS reads.
+ * */
+static void checkInit(void)
+{
+	uint8 head = g_head;
+	uint8 count = g_count;
+	uint16 seq = g_seq;
+
+	g_reads = 0;
+	AuditLog_init();
+	CHECK(g_reads <= TEST_MAX_INIT_READS);
+	CHECK((g_head == head) && (g_count == count) && (g_seq == seq));
+}
+
+/*
+ * Description: Export count entries and check expected of them come out, the newest ones
+ * 	oldest first, with consecutive sequence numbers up to the newest entry.
+ * */
+static void checkExport(uint8 count, uint8 expected)
+{
+	unsigned entries;
+	unsigned i;
+	uint16 seq;
+
+	g_exportedLength = 0;
+	g_exportEnded = FALSE;
+	AuditLog_export(count, TEST_FRAME_TYPE);
+	CHECK(g_exportEnded);
+	entries = g_exportedLength / AUDIT_LOG_ENTRY_SIZE;
+	CHECK(entries == expected);
+	for(i = 0; i < entries; i++)
+	{
+		seq = AuditLog_getSeq(g_exported + i * AUDIT_LOG_ENTRY_SIZE);
+		CHECK(seq == (uint16)(g_seq - entries + 1 + i));
+		CHECK((g_exported[i * AUDIT_LOG_ENTRY_SIZE + AUDIT_EVENT_RESULT] >> 4) == (seq & 0x0F));
+	}
+}
+
+static void append(unsigned entries)
+{
+	while(entries-- != 0)
+	{
+		CHECK(AuditLog_append((uint8)(g_seq + 1 + SpscQueue_count(&g_pending) / AUDIT_LOG_ENTRY_SIZE) & 0x0F, 0));
+		if(SpscQueue_count(&g_pending) == AUDIT_LOG_PENDING * AUDIT_LOG_ENTRY_SIZE)
+		{
+			AuditLog_flush();
+		}
+	}
+	AuditLog_flush();
+}
+
+/*
+ * Description: Blank or zeroed slots pass no CRC, a new EEPROM holds no entry.
+ * */
+static void testEmpty(void)
+{
+	uint8 fill;
+
+	for(fill = 0; fill < 2; fill++)
+	{
+		format(fill ? 0xFF : 0x00);
+		CHECK((AuditLog_getCount() == 0) && (g_head == 0));
+		checkExport(10, 0);
+	}
+}
+
+/*
+ * Description: Fill the log lap after lap with a reboot after every step, the binary search
+ * 	must land on every slot as the last one of the lap.
+ * */
+static void testLaps(void)
+{
+	unsigned step;
+
+	format(0xFF);
+	for(step = 0; step < TEST_LAPS * AUDIT_LOG_ENTRIES; step++)
+	{
+		append(1 + (step % 3) / 2);
+		checkInit();
+		if((step % 16) == 0)
+		{
+			checkExport(AUDIT_LOG_ENTRIES, AuditLog_getCount());
+			checkExport(5, (AuditLog_getCount() < 5) ? AuditLog_getCount() : 5);
+		}
+	}
+	printf("laps: %u entries, %u in the log\n", (unsigned)g_seq, (unsigned)AuditLog_getCount());
+	CHECK(AuditLog_getCount() == AUDIT_LOG_ENTRIES);
+}
+
+/*
+ * Description: The same round the 16-bit sequence number wrap, a lap then starts from a
+ * 	sequence number below the ones after it.
+ * */
+static void testSeqWrap(void)
+{
+	unsigned step;
+
+	format(0xFF);
+	g_seq = 0xFFFF - AUDIT_LOG_ENTRIES - 40;
+	for(step = 0; step < 2 * AUDIT_LOG_ENTRIES; step++)
+	{
+		append(1);
+		checkInit();
+	}
+	checkExport(AUDIT_LOG_ENTRIES, AUDIT_LOG_ENTRIES);
+	CHECK(g_seq < AUDIT_LOG_ENTRIES);
+}
+
+/*
+ * Description: A reset in the middle of a write leaves a slot that fails its CRC. On slot 0,
+ * 	where a lap starts, the lap is not seen at all: the newest entry is the one on the last
+ * 	slot and the log goes on from slot 0. Anywhere else the lap just ends before the slot,
+ * 	which the export leaves out.
+ * */
+static void testCut(void)
+{
+	uint8 slot;
+	uint16 seq;
+
+	for(slot = 0; slot < 3; slot++)
+	{
+		format(0xFF);
+		append(2 * AUDIT_LOG_ENTRIES + slot);   /* the next entry goes to slot */
+		seq = g_seq;
+		g_cutBytes = 4;
+		append(1);
+		AuditLog_init();
+		CHECK((g_seq == seq) && (g_head == slot));
+		CHECK(AuditLog_getCount() == ((slot == 0) ? AUDIT_LOG_ENTRIES - 1 : AUDIT_LOG_ENTRIES));
+		checkExport(AUDIT_LOG_ENTRIES, AUDIT_LOG_ENTRIES - 1);
+		append(3);
+		CHECK(g_seq == (uint16)(seq + 3));
+		checkInit();
+		checkExport(AUDIT_LOG_ENTRIES, AUDIT_LOG_ENTRIES);
+	}
+
+	/* before the log went round once, the slots after the cut one are empty */
+	format(0xFF);
+	append(10);
+	g_cutBytes = 7;
+	append(1);
+	AuditLog_init();
+	CHECK((g_seq == 10) && (g_head == 10) && (AuditLog_getCount() == 10));
+	checkExport(AUDIT_LOG_ENTRIES, 10);
+}
+
+/*
+ * Description: Entries appended faster than they are flushed are dropped and counted.
+ * */
+static void testDropped(void)
+{
+	uint16 dropped = AuditLog_getDropped(); /* the writes cut so far count too */
+	uint8 i;
+
+	format(0xFF);
+	for(i = 0; i < AUDIT_LOG_PENDING + 2; i++)
+	{
+		CHECK(AuditLog_append(0, 0) == (i < AUDIT_LOG_PENDING));
+	}
+	AuditLog_flush();
+	CHECK((AuditLog_getDropped() == dropped + 2) && (AuditLog_getCount() == AUDIT_LOG_PENDING));
+}
+
+int main(void)
+{
+	testEmpty();
+	testLaps();
+	testSeqWrap();
+	testCut();
+	testDropped();
+	puts(g_errors ? "FAIL" : "PASS");
+	return (g_errors != 0);
+}
@@ -0,0 +1,304 @@
+ /******************************************************************************
+ *
+ * Module: External EEPROM test
+ *
+ * File Name: external_eeprom_test.c
+ *
+ * Description: Host test of the MC2 EEPROM write-behind cache over a fake 24C16 on the TWI
+ *              engine: the updates of a page going in one write cycle, and the writes reaching
+ *              the EEPROM in the order they were made, the bus failing now and then
+ *
+ * Build and run on a PC (the driver source is included to reach its cache):
+ * 	gcc -O2 -std=gnu99 -I../MC2 external_eeprom_test.c -o external_eeprom_test
+ * 	./external_eeprom_test
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+/* The driver only takes the time from the timer driver, which needs the AVR registers */
+#define TIMER_H_
+#include "std_types.h"
+uint32 Timer_getMillis(void);
+
+#include "external_eeprom.c"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+#define TEST_EEPROM_SIZE        2048        /* 24C16 */
+#define TEST_PAGES              12          /* pages the order test writes to */
+#define TEST_REGION_SIZE        (TEST_PAGES * EEPROM_PAGE_SIZE)
+#define TEST_WRITES             4000
+#define TEST_ENTRY_SIZE         8           /* an audit log entry, two to a page */
+#define TEST_ENTRIES            128         /* the audit log pages */
+
+#define CHECK(CONDITION) do { if(!(CONDITION)) { printf("line %d: %s\n", __LINE__, #CONDITION); g_failures++; } } while(0)
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+static uint8 g_eeprom[TEST_EEPROM_SIZE];
+static uint32 g_millis = 1000;
+static unsigned long g_writeCycles;
+
+/* Every transaction fails while the bus is down */
+static boolean g_busDown = FALSE;
+
+/* Time the flush timer wakes the main loop, 0 when it is not running */
+static uint32 g_flushDue;
+
+/*
+ * The test region after each of the writes made so far, and the last one the EEPROM matched.
+ * The one being made is a snapshot ahead, a write through reaches the EEPROM before it returns.
+ */
+static uint8 g_snapshots[TEST_WRITES + 2][TEST_REGION_SIZE];
+static unsigned g_made;
+static unsigned g_matched;
+static boolean g_ordering = FALSE;
+
+static unsigned long g_failures;
+static unsigned long g_random = 2463534242UL;
+
+/*******************************************************************************
+ *                      Fakes                                                  *
+ *******************************************************************************/
+uint32 Timer_getMillis(void)
+{
+	return g_millis;
+}
+
+void Power_idle(void)
+{
+}
+
+void SwTimer_start(SwTimer *timer, uint16 period_ms, SwTimer_mode mode, void (*callBackPtr)(void))
+{
+	if(timer == &g_flushTimer)
+	{
+		g_flushDue = g_millis + period_ms;
+	}
+}
+
+void SwTimer_cancel(SwTimer *timer)
+{
+	if(timer == &g_flushTimer)
+	{
+		g_flushDue = 0;
+	}
+}
+
+boolean SwTimer_isActive(const SwTimer *timer)
+{
+	return FALSE; /* the back-off is over at once */
+}
+
+/*
+ * Description: Every write the EEPROM gets must leave it as it was after one of the writes made,
+ * 	a later one than the last write did.
+ * */
+static void checkOrder(void)
+{
+	while((g_matched <= g_made + 1) && (memcmp(g_eeprom, g_snapshots[g_matched], TEST_REGION_SIZE) != 0))
+	{
+		g_matched++;
+	}
+	CHECK(g_matched <= g_made + 1);
+	if(g_matched > g_made + 1)
+	{
+		g_ordering = FALSE; /* one report is enough */
+	}
+}
+
+/*
+ * Description: A 24C16 done at once: the word address, then the data of a page write, which
+ * 	wraps round inside the page, or the bytes of a sequential read.
+ * */
+boolean TWI_submit(TWI_Transaction *transaction)
+{
+	uint16 address = (uint16)(transaction->slaveAddress & 0x07) << 8;
+	uint8 i;
+
+	CHECK((transaction->slaveAddress & 0x78) == 0x50);
+	if(g_busDown)
+	{
+		transaction->status = TWI_TRANSACTION_FAILED;
+		return TRUE;
+	}
+	if(transaction->writeLength != 0)
+	{
+		address |= transaction->writeData[0];
+	}
+	if(transaction->writeLength > 1)
+	{
+		CHECK(transaction->writeLength <= EEPROM_PAGE_SIZE + 1);
+		for(i = 0; i < transaction->writeLength - 1; i++)
+		{
+			g_eeprom[(address & ~(EEPROM_PAGE_SIZE - 1)) | ((address + i) & (EEPROM_PAGE_SIZE - 1))] = transaction->writeData[i + 1];
+		}
+		g_writeCycles++;
+		if(g_ordering)
+		{
+			checkOrder();
+		}
+	}
+	for(i = 0; i < transaction->readLength; i++)
+	{
+		transaction->readData[i] = g_eeprom[(address + i) % TEST_EEPROM_SIZE];
+	}
+	transaction->status = TWI_TRANSACTION_DONE;
+	return TRUE;
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+static unsigned long random32(void)
+{
+	g_random ^= g_random << 13;
+	g_random ^= g_random >> 17;
+	g_random ^= g_random << 5;
+	return g_random & 0xFFFFFFFFUL;
+}
+
+static void format(void)
+{
+	memset(g_eeprom, 0xFF, sizeof(g_eeprom));
+	g_cacheCount = 0;
+	g_flushDue = 0;
+	g_writeCycles = 0;
+}
+
+/*
+ * Description: Let time pass in the main loop, which services the cache when the flush timer
+ * 	wakes it up.
+ * */
+static void wait(uint32 ms)
+{
+	while(ms-- != 0)
+	{
+		g_millis++;
+		if((g_flushDue != 0) && (g_millis >= g_flushDue))
+		{
+			EEPROM_service();
+		}
+	}
+}
+
+/*
+ * Description: Audit log entries one after the other, closer than the idle time: each page is
+ * 	written once with both its entries, after the cache ran out of pages or went quiet.
+ * */
+static void testCoalesce(void)
+{
+	uint8 entry[TEST_ENTRY_SIZE];
+	uint8 readBack[TEST_ENTRY_SIZE];
+	uint16 address = 64 * EEPROM_PAGE_SIZE;
+	unsigned i;
+
+	format();
+	for(i = 0; i < TEST_ENTRIES; i++)
+	{
+		memset(entry, (uint8)i, sizeof(entry));
+		CHECK(EEPROM_writeBehind(address + i * TEST_ENTRY_SIZE, entry, sizeof(entry)) == SUCCESS);
+		CHECK(EEPROM_readBuffer(address + i * TEST_ENTRY_SIZE, readBack, sizeof(readBack)) == SUCCESS);
+		CHECK(memcmp(readBack, entry, sizeof(entry)) == 0);
+		wait(random32() % EEPROM_CACHE_IDLE_MS);
+	}
+	CHECK(g_flushDue != 0);
+	wait(EEPROM_CACHE_IDLE_MS);
+	CHECK((g_cacheCount == 0) && (g_flushDue == 0));
+	printf("coalesce: %u entries, %lu write cycles\n", TEST_ENTRIES, g_writeCycles);
+	CHECK(g_writeCycles == TEST_ENTRIES * TEST_ENTRY_SIZE / EEPROM_PAGE_SIZE);
+	for(i = 0; i < TEST_ENTRIES * TEST_ENTRY_SIZE; i++)
+	{
+		CHECK(g_eeprom[address + i] == (uint8)(i / TEST_ENTRY_SIZE));
+	}
+
+	/* a page updated without a pause is written by its deadline */
+	format();
+	for(i = 0; g_writeCycles == 0; i++)
+	{
+		entry[0] = (uint8)i;
+		CHECK(EEPROM_writeBehind(address, entry, 1) == SUCCESS);
+		wait(EEPROM_CACHE_IDLE_MS / 2);
+	}
+	CHECK(i * (EEPROM_CACHE_IDLE_MS / 2) <= EEPROM_CACHE_DEADLINE_MS + EEPROM_CACHE_IDLE_MS);
+}
+
+/*
+ * Description: Random writes behind and through to a few pages, and the bus down now and then.
+ * 	The EEPROM always holds the data of the writes made up to one of them, so a reset at any
+ * 	time loses only the newest writes. Reads always see the newest data.
+ * */
+static void testOrder(void)
+{
+	uint8 data[EEPROM_PAGE_SIZE];
+	uint8 readBack[TEST_REGION_SIZE];
+	uint16 address;
+	uint8 length;
+	uint8 status;
+	unsigned failed = 0;
+	unsigned i;
+
+	format();
+	memcpy(g_snapshots[0], g_eeprom, TEST_REGION_SIZE);
+	g_made = 0;
+	g_matched = 0;
+	g_ordering = TRUE;
+	while(g_made < TEST_WRITES)
+	{
+		/* inside one page, writes through split into pages would pass through a mix of two */
+		address = (uint16)(random32() % TEST_REGION_SIZE);
+		length = (uint8)(1 + random32() % (EEPROM_PAGE_SIZE - address % EEPROM_PAGE_SIZE));
+		for(i = 0; i < length; i++)
+		{
+			data[i] = (uint8)random32();
+		}
+		memcpy(g_snapshots[g_made + 1], g_snapshots[g_made], TEST_REGION_SIZE);
+		memcpy(g_snapshots[g_made + 1] + address, data, length);
+		g_busDown = ((random32() % 16) == 0);
+		if((random32() % 8) == 0)
+		{
+			status = EEPROM_writeBuffer(address, data, length);
+		}
+		else
+		{
+			status = EEPROM_writeBehind(address, data, length);
+		}
+		g_busDown = FALSE;
+
+		if(status == SUCCESS)
+		{
+			g_made++;
+		}
+		else
+		{
+			/* a write that failed did not reach the EEPROM, unless it changed nothing */
+			CHECK((g_matched <= g_made) || (memcmp(g_snapshots[g_made], g_snapshots[g_made + 1], TEST_REGION_SIZE) == 0));
+			g_matched = (g_matched > g_made) ? g_made : g_matched;
+			failed++;
+		}
+
+		CHECK(EEPROM_readBuffer(0, readBack, TEST_REGION_SIZE) == SUCCESS);
+		CHECK(memcmp(readBack, g_snapshots[g_made], TEST_REGION_SIZE) == 0);
+		g_busDown = ((random32() % 16) == 0);
+		wait(random32() % (2 * EEPROM_CACHE_IDLE_MS));
+		g_busDown = FALSE;
+	}
+	CHECK(EEPROM_flush() == SUCCESS);
+	CHECK((g_cacheCount == 0) && (g_matched == g_made));
+	g_ordering = FALSE;
+	printf("order: %u writes, %u failed, %lu write cycles\n", g_made, failed, g_writeCycles);
+}
+
+int main(void)
+{
+	testCoalesce();
+	testOrder();
+	puts(g_failures ? "FAIL" : "PASS");
+	return (g_failures != 0);
+}
@@ -0,0 +1,333 @@
+ /******************************************************************************
+ *
+ * Module: RECORD_STORE test
+ *
+ * File Name: record_store_test.c
+ *
+ * Description: Host test of the MC2 record store over a fake 24C16: the log wrapping round its
+ *              pages with the compaction of static keys, the head found again by the boot scan,
+ *              and writes cut by a reset at every step
+ *
+ * Build and run on a PC:
+ * 	gcc -O2 -std=gnu99 -I../MC2 record_store_test.c ../MC2/record_store.c ../MC2/crc.c -o record_store_test
+ * 	./record_store_test
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "record_store.h"
+#include "crc.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+#define TEST_EEPROM_SIZE        2048        /* 24C16 */
+#define TEST_NO_CUT             (-1)
+#define TEST_WRAP_WRITES        5000        /* about 80 times round the log */
+#define TEST_RANDOM_WRITES      3000
+#define TEST_TRACE_LENGTH       8192
+
+#define CHECK(CONDITION) do { if(!(CONDITION)) { printf("line %d: %s\n", __LINE__, #CONDITION); g_errors++; } } while(0)
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+static uint8 g_eeprom[TEST_EEPROM_SIZE];
+static unsigned long g_pageWrites[TEST_EEPROM_SIZE / EEPROM_PAGE_SIZE];
+
+/* Page writes left before the power is cut in the middle of one, TEST_NO_CUT for none */
+static int g_cutAfter = TEST_NO_CUT;
+/* The page cut last passes its CRC all the same, as a CRC-8 lets 1 in 256 through */
+static boolean g_cutPassesCrc = FALSE;
+static unsigned long g_collisions;
+
+/* Pages written, in order, while the trace is on */
+static uint8 g_trace[TEST_TRACE_LENGTH];
+static unsigned g_traceLength;
+static boolean g_tracing = FALSE;
+
+static unsigned long g_errors;
+static unsigned long g_random = 2463534242UL;
+
+/* A static key, written once, and a configuration key written now and then */
+static const uint8 g_static[] = "static";
+static const uint8 g_config[] = {0xC0, 0x0F};
+
+/*******************************************************************************
+ *                      Fake EEPROM                                            *
+ *******************************************************************************/
+uint8 EEPROM_readBuffer(uint16 u16addr, uint8 *data, uint16 length)
+{
+	memcpy(data, g_eeprom + u16addr, length);
+	return SUCCESS;
+}
+
+uint8 EEPROM_writeBuffer(uint16 u16addr, const uint8 *data, uint16 length)
+{
+	CHECK((length == EEPROM_PAGE_SIZE) && ((u16addr % EEPROM_PAGE_SIZE) == 0));
+	CHECK(u16addr < (RECORD_STORE_FIRST_PAGE + RECORD_STORE_PAGES) * EEPROM_PAGE_SIZE);
+	if(g_cutAfter == 0)
+	{
+		/* the power goes in the middle of the page write */
+		memcpy(g_eeprom + u16addr, data, length / 2);
+		g_cutAfter = TEST_NO_CUT;
+		g_cutPassesCrc = (CRC8_computeFrom(CRC8_STORAGE_INITIAL_VALUE, g_eeprom + u16addr, length - 1) ==
+				g_eeprom[u16addr + length - 1]);
+		g_collisions += g_cutPassesCrc;
+		return ERROR;
+	}
+	if(g_cutAfter > 0)
+	{
+		g_cutAfter--;
+	}
+	memcpy(g_eeprom + u16addr, data, length);
+	g_pageWrites[u16addr / EEPROM_PAGE_SIZE]++;
+	if(g_tracing && (g_traceLength < TEST_TRACE_LENGTH))
+	{
+		g_trace[g_traceLength++] = (uint8)(u16addr / EEPROM_PAGE_SIZE);
+	}
+	return SUCCESS;
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+static unsigned long random32(void)
+{
+	g_random ^= g_random << 13;
+	g_random ^= g_random >> 17;
+	g_random ^= g_random << 5;
+	return g_random & 0xFFFFFFFFUL;
+}
+
+static void format(uint8 fill)
+{
+	memset(g_eeprom, fill, sizeof(g_eeprom));
+	memset(g_pageWrites, 0, sizeof(g_pageWrites));
+	RecordStore_init();
+}
+
+static void fillValue(uint8 *value, unsigned long n)
+{
+	uint8 i;
+
+	for(i = 0; i < 5; i++)
+	{
+		value[i] = (uint8)(n >> (i * 3));
+	}
+}
+
+static boolean holds(uint8 key, const uint8 *value, uint8 length)
+{
+	uint8 data[RECORD_STORE_PAYLOAD_SIZE];
+	uint8 readLength;
+
+	return (RecordStore_read(key, data, &readLength) == SUCCESS) && (readLength == length) &&
+			(memcmp(data, value, length) == 0);
+}
+
+/*
+ * Description: Blank or zeroed pages pass no CRC, a new EEPROM holds no record.
+ * */
+static void testEmpty(void)
+{
+	uint8 fill;
+	uint8 key;
+
+	for(fill = 0; fill < 2; fill++)
+	{
+		format(fill ? 0xFF : 0x00);
+		for(key = 0; key < RECORD_STORE_MAX_KEYS; key++)
+		{
+			CHECK(!RecordStore_contains(key));
+		}
+	}
+	CHECK(RecordStore_write(RECORD_STORE_MAX_KEYS, g_config, 1) == ERROR);
+	CHECK(RecordStore_write(0, g_config, RECORD_STORE_PAYLOAD_SIZE + 1) == ERROR);
+}
+
+/*
+ * Description: One key written over and over with two keys that stay: the log goes round its
+ * 	pages many times, the static records are copied forward and every page wears the same.
+ * */
+static void testWrap(void)
+{
+	uint8 value[5];
+	unsigned long n;
+	unsigned long least = (unsigned long)-1;
+	unsigned long most = 0;
+	uint8 page;
+
+	format(0xFF);
+	CHECK(RecordStore_write(3, g_static, sizeof(g_static)) == SUCCESS);
+	CHECK(RecordStore_write(5, g_config, sizeof(g_config)) == SUCCESS);
+	for(n = 0; n < TEST_WRAP_WRITES; n++)
+	{
+		fillValue(value, n);
+		CHECK(RecordStore_write(0, value, sizeof(value)) == SUCCESS);
+		if((n % 97) == 0)
+		{
+			RecordStore_init();
+		}
+		CHECK(holds(0, value, sizeof(value)));
+		CHECK(holds(3, g_static, sizeof(g_static)));
+		CHECK(holds(5, g_config, sizeof(g_config)));
+	}
+	for(page = 0; page < RECORD_STORE_PAGES; page++)
+	{
+		least = (g_pageWrites[page] < least) ? g_pageWrites[page] : least;
+		most = (g_pageWrites[page] > most) ? g_pageWrites[page] : most;
+	}
+	printf("wrap: %u writes, page wear %lu to %lu\n", TEST_WRAP_WRITES, least, most);
+	CHECK(most - least <= most / 16);
+}
+
+/*
+ * Description: Run the same writes twice, the second time with a reboot before every write. The
+ * 	boot scan must find the head where the running store had it, past the compaction copies
+ * 	written just before the newest record, so both runs write the same pages in the same order.
+ * */
+static void runTrace(boolean reboot)
+{
+	uint8 value[5];
+	unsigned long n;
+
+	format(0xFF);
+	g_traceLength = 0;
+	g_tracing = TRUE;
+	CHECK(RecordStore_write(3, g_static, sizeof(g_static)) == SUCCESS);
+	CHECK(RecordStore_write(5, g_config, sizeof(g_config)) == SUCCESS);
+	CHECK(RecordStore_write(6, g_config, 1) == SUCCESS);
+	for(n = 0; n < 1000; n++)
+	{
+		if(reboot)
+		{
+			RecordStore_init();
+		}
+		fillValue(value, n);
+		CHECK(RecordStore_write(((n % 11) == 0) ? 1 : 0, value, sizeof(value)) == SUCCESS);
+	}
+	g_tracing = FALSE;
+}
+
+static void testHeadAfterReboot(void)
+{
+	static uint8 running[TEST_TRACE_LENGTH];
+	unsigned runningLength;
+	unsigned copies;
+
+	runTrace(FALSE);
+	memcpy(running, g_trace, g_traceLength);
+	runningLength = g_traceLength;
+	runTrace(TRUE);
+
+	/* more page writes than records written means the static keys were copied forward */
+	copies = runningLength - 1003;
+	printf("head: %u page writes, %u compaction copies\n", runningLength, copies);
+	CHECK(copies > 0);
+	CHECK((g_traceLength == runningLength) && (memcmp(g_trace, running, runningLength) == 0));
+}
+
+/*
+ * Description: The power cut in the middle of a write, of the new record or of any compaction
+ * 	copy before it. After the reboot every key holds its last value written, or the value being
+ * 	written for the key whose write was cut, and the store goes on working.
+ * */
+static void testPowerCut(void)
+{
+	static const uint8 keys[] = {0, 1, 2, 4};
+	uint8 last[RECORD_STORE_MAX_KEYS][5];
+	boolean written[RECORD_STORE_MAX_KEYS] = {FALSE};
+	uint8 value[5];
+	unsigned long n;
+	unsigned long cuts = 0;
+	uint8 key;
+	uint8 i;
+
+	format(0xFF);
+	CHECK(RecordStore_write(3, g_static, sizeof(g_static)) == SUCCESS);
+	CHECK(RecordStore_write(5, g_config, sizeof(g_config)) == SUCCESS);
+	for(n = 0; n < TEST_RANDOM_WRITES; n++)
+	{
+		key = keys[random32() % sizeof(keys)];
+		fillValue(value, random32());
+		g_cutAfter = ((random32() % 4) == 0) ? (int)(random32() % 3) : TEST_NO_CUT;
+		g_cutPassesCrc = FALSE;
+		if(RecordStore_write(key, value, sizeof(value)) == SUCCESS)
+		{
+			memcpy(last[key], value, sizeof(value));
+			written[key] = TRUE;
+		}
+		else
+		{
+			cuts++;
+			RecordStore_init();
+			if(g_cutPassesCrc)
+			{
+				/* half old and half new bytes taken for a record: beyond a CRC-8, start the key again */
+				CHECK(RecordStore_write(key, value, sizeof(value)) == SUCCESS);
+			}
+			if(g_cutPassesCrc || holds(key, value, sizeof(value)))
+			{
+				memcpy(last[key], value, sizeof(value));
+				written[key] = TRUE;
+			}
+		}
+		g_cutAfter = TEST_NO_CUT;
+		if((random32() % 8) == 0)
+		{
+			RecordStore_init();
+		}
+		for(i = 0; i < sizeof(keys); i++)
+		{
+			CHECK(!written[keys[i]] || holds(keys[i], last[keys[i]], sizeof(value)));
+		}
+		CHECK(holds(3, g_static, sizeof(g_static)));
+		CHECK(holds(5, g_config, sizeof(g_config)));
+	}
+	printf("power cut: %lu writes, %lu cut, %lu cut pages passed the CRC\n", (unsigned long)TEST_RANDOM_WRITES, cuts, g_collisions);
+}
+
+/*
+ * Description: A current record gone bad in place falls back to the previous generation.
+ * */
+static void testBitRot(void)
+{
+	static const uint8 previous[] = {1, 2, 3};
+	static const uint8 current[] = {4, 5, 6};
+	uint16 address;
+	uint16 rotten = TEST_EEPROM_SIZE;
+
+	format(0xFF);
+	CHECK(RecordStore_write(2, previous, sizeof(previous)) == SUCCESS);
+	CHECK(RecordStore_write(2, current, sizeof(current)) == SUCCESS);
+	for(address = 0; address < RECORD_STORE_PAGES * EEPROM_PAGE_SIZE; address += EEPROM_PAGE_SIZE)
+	{
+		if((g_eeprom[address] == 2) && (memcmp(g_eeprom + address + 4, current, sizeof(current)) == 0))
+		{
+			rotten = address + 4;
+		}
+	}
+	CHECK(rotten < TEST_EEPROM_SIZE);
+	g_eeprom[rotten] ^= 0x01;
+	CHECK(holds(2, previous, sizeof(previous)));
+	RecordStore_init();
+	CHECK(holds(2, previous, sizeof(previous)));
+	g_eeprom[rotten] ^= 0x01;
+	RecordStore_init();
+	CHECK(holds(2, current, sizeof(current)));
+}
+
+int main(void)
+{
+	testEmpty();
+	testWrap();
+	testHeadAfterReboot();
+	testPowerCut();
+	testBitRot();
+	puts(g_errors ? "FAIL" : "PASS");
+	return (g_errors != 0);
+}
@@ -0,0 +1,142 @@
+ /******************************************************************************
+ *
+ * Module: SPSC_QUEUE test
+ *
+ * File Name: spsc_queue_stress.c
+ *
+ * Description: Host stress test of spsc_queue.h, a producer and a consumer thread
+ *              hammer one queue from two cores and check every byte comes out in order
+ *
+ * Build and run on a PC (the queue header is the same in MC1 and MC2):
+ * 	gcc -O2 -std=gnu99 -pthread -I../MC1 spsc_queue_stress.c -o spsc_queue_stress
+ * 	./spsc_queue_stress
+ *
+ * Author: Hisham Elsayed
+ *
+ *******************************************************************************/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include "spsc_queue.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+#define STRESS_BYTES            3000000UL   /* bytes sent through each queue */
+#define STRESS_WRITE_SIZE       3           /* producer record size, mixed with single pushes */
+#define STRESS_READ_SIZE        2           /* consumer record size, mixed with single pops */
+
+/*******************************************************************************
+ *                           Global Variables                                  *
+ *******************************************************************************/
+/* The smallest and the largest queue sizes, the small one is full or empty most of the time */
+static uint8 g_smallBuffer[8];
+static uint8 g_largeBuffer[SPSC_QUEUE_MAX_SIZE];
+static SpscQueue g_smallQueue = SPSC_QUEUE_INITIALIZER(g_smallBuffer);
+static SpscQueue g_largeQueue = SPSC_QUEUE_INITIALIZER(g_largeBuffer);
+
+static SpscQueue *g_queue;
+static unsigned long g_errors;
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+/*
+ * Description: Producer thread, sends the byte sequence 0, 1, 2... (mod 256) as a mix of
+ * 	single pushes and multi-byte records, yielding whenever the queue is full.
+ * */
+static void *producer(void *arg)
+{
+	unsigned long sent = 0;
+	uint8 record[STRESS_WRITE_SIZE];
+	uint8 i;
+
+	(void)arg;
+	while(sent < STRESS_BYTES)
+	{
+		if(((sent % 7) == 3) && (sent + STRESS_WRITE_SIZE <= STRESS_BYTES))
+		{
+			for(i = 0; i < STRESS_WRITE_SIZE; i++)
+			{
+				record[i] = (uint8)(sent + i);
+			}
+			if(SpscQueue_write(g_queue, record, STRESS_WRITE_SIZE))
+			{
+				sent += STRESS_WRITE_SIZE;
+				continue;
+			}
+		}
+		else if(SpscQueue_push(g_queue, (uint8)sent))
+		{
+			sent++;
+			continue;
+		}
+		sched_yield();
+	}
+	return NULL;
+}
+
+/*
+ * Description: Consumer thread, takes the bytes out as a mix of single pops and multi-byte
+ * 	records with a different pattern from the producer, counting every byte out of order.
+ * */
+static void *consumer(void *arg)
+{
+	unsigned long received = 0;
+	uint8 record[STRESS_READ_SIZE];
+	uint8 i;
+
+	(void)arg;
+	while(received < STRESS_BYTES)
+	{
+		if(((received % 5) == 1) && (received + STRESS_READ_SIZE <= STRESS_BYTES))
+		{
+			if(SpscQueue_read(g_queue, record, STRESS_READ_SIZE))
+			{
+				for(i = 0; i < STRESS_READ_SIZE; i++)
+				{
+					g_errors += (record[i] != (uint8)(received + i));
+				}
+				received += STRESS_READ_SIZE;
+				continue;
+			}
+		}
+		else if(SpscQueue_pop(g_queue, record))
+		{
+			g_errors += (record[0] != (uint8)received);
+			received++;
+			continue;
+		}
+		sched_yield();
+	}
+	/* Nothing may be left over once every byte has been taken */
+	g_errors += !SpscQueue_isEmpty(g_queue);
+	return NULL;
+}
+
+int main(void)
+{
+	SpscQueue *queues[] = {&g_smallQueue, &g_largeQueue};
+	pthread_t producerThread;
+	pthread_t consumerThread;
+	unsigned long failed = 0;
+	uint8 i;
+
+	for(i = 0; i < sizeof(queues) / sizeof(queues[0]); i++)
+	{
+		g_queue = queues[i];
+		g_errors = 0;
+		pthread_create(&producerThread, NULL, producer, NULL);
+		pthread_create(&consumerThread, NULL, consumer, NULL);
+		pthread_join(producerThread, NULL);
+		pthread_join(consumerThread, NULL);
+		printf("queue of %3u bytes: %lu bytes, %lu errors\n",
+				(unsigned)(g_queue->mask + 1), STRESS_BYTES, g_errors);
+		failed += g_errors;
+	}
+	puts(failed ? "FAIL" : "PASS");
+	return (failed != 0);
+}